@@ -0,0 +1,1008 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <ctime>
+#include <iterator>
+#include <memory>
+#include <csignal>
+
+#include <unistd.h>
+#include <unicase.h>
+
+#include <libsentences/text_sentences.h>
+#include <libsentences/stream_sentences.h>
+#include <libsentences/sbd_model.h>
+#include <libsentences/sbd_model_inspector.h>
+#include <libsentences/sbd_context.h>
+#include <libsentences/standard_tokenizer.h>
+#include <libsentences/utf8_iterator.h>
+
+using namespace std;
+using namespace libsentences;
+
+// Word lists and abbreviations of the languages in the synthetic corpus.
+struct bench_language {
+    vector<string> words;
+    vector<string> abbreviations;
+    vector<string> terminators;
+};
+
+static vector<bench_language> bench_languages() {
+    return {
+        {{"the", "report", "committee", "meeting", "was", "held", "in",
+          "ministry", "of", "health", "and", "members", "warned", "that",
+          "private", "hospitals", "should", "not", "receive", "funding",
+          "while", "public", "ones", "wait", "for", "new", "equipment"},
+         {"Mr.", "Dr.", "Prof.", "e.g.", "i.e.", "etc.", "U.S.", "Inc.",
+          "No.", "Jan."},
+         {".", ".", ".", "?", "!"}},
+        {{"prvi", "zapisnik", "odnosi", "se", "na", "sastanak",
+          "povjerenstva", "održan", "ožujka", "članovi", "upozoravaju",
+          "štetnu", "praksu", "prepuštanja", "dijagnostike", "privatnim",
+          "zdravstvenim", "ustanovama", "društva", "radiologa", "uz",
+          "ostalo", "stoji", "budući", "da", "je", "obrnuto", "Đakovo"},
+         {"prof.", "dr.", "npr.", "tj.", "sl.", "god.", "br.", "st."},
+         {".", ".", ".", "?", "!"}},
+        {{"die", "Sitzung", "des", "Ausschusses", "fand", "im",
+          "Gesundheitsministerium", "statt", "und", "Mitglieder",
+          "warnten", "vor", "schädlichen", "Praxis", "über", "größere",
+          "Krankenhäuser", "Straße", "müssen", "öffentliche", "Gebäude"},
+         {"z.B.", "Nr.", "Dr.", "bzw.", "usw.", "ca.", "Str.", "S."},
+         {".", ".", ".", "?", "!"}},
+        {{"заседание", "комиссии", "прошло", "в", "министерстве",
+          "здравоохранения", "члены", "предупредили", "о", "вредной",
+          "практике", "частных", "больниц", "и", "общественных",
+          "учреждений", "который", "был", "новый", "город"},
+         {"т.е.", "г.", "др.", "см.", "стр.", "им.", "ул."},
+         {".", ".", ".", "?", "!", "…"}},
+        {{"η", "συνεδρίαση", "της", "επιτροπής", "έγινε", "στο",
+          "υπουργείο", "υγείας", "και", "τα", "μέλη", "προειδοποίησαν",
+          "για", "ιδιωτικά", "νοσοκομεία", "δημόσια", "ιδρύματα"},
+         {"κ.", "π.χ.", "δηλ.", "αρ.", "σελ."},
+         {".", ".", ";", "!"}},
+        {{"委员会", "会议", "在", "卫生部", "举行", "成员", "警告",
+          "私立", "医院", "公共", "机构", "的", "做法", "有害", "新", "设备"},
+         {},
+         {"。", "。", "？", "！"}},
+    };
+}
+
+static string capitalize(const string &word) {
+    utf8_iterator i(word);
+    unicode_char first = uc_toupper(i.dereference_and_increment());
+    return static_cast<string>(first) + word.substr(i.ptr() - word.c_str());
+}
+
+// Synthetic multilingual corpus. text has paragraphs of sentences separated
+// by spaces, gold has one sentence per line.
+struct bench_corpus {
+    string text;
+    string gold;
+    int n_sentences;
+};
+
+static bench_corpus generate_corpus(size_t n_bytes, unsigned seed) {
+    vector<bench_language> languages = bench_languages();
+    mt19937 rng(seed);
+    auto chance = [&](int percent) {
+        return static_cast<int>(rng() % 100) < percent;
+    };
+    auto pick = [&](const vector<string> &v) -> const string & {
+        return v[rng() % v.size()];
+    };
+
+    bench_corpus corpus;
+    corpus.n_sentences = 0;
+    while (corpus.text.size() < n_bytes) {
+        const bench_language &lang = languages[rng() % languages.size()];
+        int n_sentences = 3 + rng() % 6;
+        for (int s = 0; s < n_sentences; ++s) {
+            string sentence;
+            int n_words = 4 + rng() % 16;
+            bool quoted = false;
+            for (int w = 0; w < n_words; ++w) {
+                string word;
+                if (!lang.abbreviations.empty() && chance(8)) {
+                    word = pick(lang.abbreviations);
+                } else if (chance(6)) {
+                    word = to_string(rng() % 3000);
+                    if (chance(40)) {
+                        word += '.';
+                    }
+                } else if (chance(3)) {
+                    // Initial
+                    word = capitalize(pick(lang.words));
+                    utf8_iterator i(word);
+                    ++i;
+                    word = word.substr(0, i.ptr() - word.c_str()) + ".";
+                } else {
+                    word = pick(lang.words);
+                    if (w == 0 || chance(10)) {
+                        word = capitalize(word);
+                    }
+                }
+                if (chance(3) && !quoted) {
+                    word = "“" + word;
+                    quoted = true;
+                } else if (quoted && chance(20)) {
+                    word += "”";
+                    quoted = false;
+                }
+                if (w + 1 < n_words && chance(8)) {
+                    word += ',';
+                }
+                sentence += (w ? " " : "") + word;
+            }
+            if (quoted) {
+                sentence += "”";
+            }
+            sentence += pick(lang.terminators);
+            corpus.text += (s ? " " : "") + sentence;
+            corpus.gold += sentence + '\n';
+            ++corpus.n_sentences;
+        }
+        corpus.text += "\n\n";
+    }
+    return corpus;
+}
+
+static volatile size_t bench_sink;
+
+struct bench_result {
+    string name;
+    string item_name;
+    // Bytes and items processed by every repetition.
+    size_t n_bytes;
+    size_t n_items;
+    vector<double> seconds;
+};
+
+// Runs func (which returns the number of items it processed) warmup times
+// and then reps times, timing each repetition.
+template<class F>
+static bench_result run_bench(const string &name, const string &item_name,
+                              size_t n_bytes, int warmup, int reps, F func) {
+    bench_result rez;
+    rez.name = name;
+    rez.item_name = item_name;
+    rez.n_bytes = n_bytes;
+    rez.n_items = 0;
+    for (int i = 0; i < warmup; ++i) {
+        bench_sink += func();
+    }
+    for (int i = 0; i < reps; ++i) {
+        auto start = chrono::steady_clock::now();
+        rez.n_items = func();
+        rez.seconds.push_back(chrono::duration<double>(
+                    chrono::steady_clock::now() - start).count());
+        bench_sink += rez.n_items;
+    }
+    return rez;
+}
+
+static double median(vector<double> v) {
+    sort(v.begin(), v.end());
+    size_t n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static vector<double> ns_per_byte(const bench_result &r) {
+    vector<double> rez;
+    for (unsigned i = 0; i < r.seconds.size(); ++i) {
+        rez.push_back(r.seconds[i] * 1e9 / r.n_bytes);
+    }
+    return rez;
+}
+
+static void print_table_header() {
+    cout << left << setw(18) << "benchmark" << right << setw(10)
+         << "ns/byte" << setw(10) << "min" << setw(10) << "mean"
+         << setw(9) << "sd" << setw(14) << "throughput" << '\n';
+}
+
+static void print_result(const bench_result &r) {
+    vector<double> t = ns_per_byte(r);
+    double mean = accumulate(t.begin(), t.end(), 0.) / t.size();
+    double var = 0;
+    for (unsigned i = 0; i < t.size(); ++i) {
+        var += (t[i] - mean) * (t[i] - mean);
+    }
+    double sd = t.size() > 1 ? sqrt(var / (t.size() - 1)) : 0;
+    double items_per_second = r.n_items / median(r.seconds);
+    cout << left << setw(18) << r.name << right << fixed << setprecision(3)
+         << setw(10) << median(t)
+         << setw(10) << *min_element(t.begin(), t.end())
+         << setw(10) << mean << setw(9) << sd
+         << setprecision(0) << setw(14) << items_per_second << ' '
+         << r.item_name << "/s\n";
+    cout.unsetf(ios_base::floatfield);
+}
+
+// Run metadata stored with machine-readable results.
+struct bench_metadata {
+    string date;
+    string cpu;
+    string compiler;
+    string build_type;
+    size_t corpus_bytes;
+    unsigned seed;
+    int reps;
+    int warmup;
+};
+
+static string cpu_name() {
+    ifstream ifs("/proc/cpuinfo");
+    for (string line; getline(ifs, line);) {
+        if (line.compare(0, 10, "model name") == 0 &&
+            line.find(':') != string::npos) {
+            return line.substr(line.find(':') + 2);
+        }
+    }
+    return "unknown";
+}
+
+static string compiler_name() {
+#if defined(__clang__)
+    return "clang " __clang_version__;
+#elif defined(__GNUC__)
+    return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    return "msvc " + to_string(_MSC_VER);
+#else
+    return "unknown";
+#endif
+}
+
+static string build_type() {
+#if defined(BENCH_BUILD_TYPE)
+    if (strlen(BENCH_BUILD_TYPE)) {
+        return BENCH_BUILD_TYPE;
+    }
+#endif
+#ifdef NDEBUG
+    return "NDEBUG";
+#else
+    return "assertions enabled";
+#endif
+}
+
+static string json_string(const string &s) {
+    string rez = "\"";
+    for (unsigned i = 0; i < s.size(); ++i) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            rez += '\\';
+            rez += c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            rez += buf;
+        } else {
+            rez += c;
+        }
+    }
+    return rez + '"';
+}
+
+static void print_json(const bench_metadata &m,
+                       const vector<bench_result> &results) {
+    cout << "{\n  \"context\": {\n"
+         << "    \"date\": " << json_string(m.date) << ",\n"
+         << "    \"cpu\": " << json_string(m.cpu) << ",\n"
+         << "    \"compiler\": " << json_string(m.compiler) << ",\n"
+         << "    \"build_type\": " << json_string(m.build_type) << ",\n"
+         << "    \"corpus_bytes\": " << m.corpus_bytes << ",\n"
+         << "    \"seed\": " << m.seed << ",\n"
+         << "    \"repetitions\": " << m.reps << ",\n"
+         << "    \"warmup\": " << m.warmup << "\n  },\n"
+         << "  \"benchmarks\": [";
+    cout << setprecision(9);
+    for (unsigned i = 0; i < results.size(); ++i) {
+        const bench_result &r = results[i];
+        cout << (i ? ",\n" : "\n")
+             << "    {\"name\": " << json_string(r.name)
+             << ", \"unit\": " << json_string(r.item_name)
+             << ", \"bytes\": " << r.n_bytes
+             << ", \"items\": " << r.n_items
+             << ", \"seconds\": [";
+        for (unsigned j = 0; j < r.seconds.size(); ++j) {
+            cout << (j ? ", " : "") << r.seconds[j];
+        }
+        cout << "]}";
+    }
+    cout << "\n  ]\n}\n";
+}
+
+// Just enough of a JSON parser to read back print_json's output.
+struct json_value {
+    enum value_type { null, boolean, number, string_value, array, object };
+    value_type type;
+    double num;
+    string str;
+    vector<json_value> items;
+    vector<pair<string, json_value>> members;
+
+    const json_value &operator[](const string &key) const;
+};
+
+const json_value &json_value::operator[](const string &key) const {
+    for (unsigned i = 0; i < members.size(); ++i) {
+        if (members[i].first == key) {
+            return members[i].second;
+        }
+    }
+    throw runtime_error("Missing \"" + key + "\" in benchmark results.");
+}
+
+class json_parser {
+public:
+    explicit json_parser(const string &text_) : text(text_), pos(0) {
+    }
+    json_value parse();
+private:
+    void skip_whitespace();
+    char expect(const char *chars);
+    unsigned parse_hex4();
+    string parse_string();
+
+    const string &text;
+    size_t pos;
+};
+
+void json_parser::skip_whitespace() {
+    while (pos < text.size() && isspace(static_cast<unsigned char>(
+                    text[pos]))) {
+        ++pos;
+    }
+}
+
+char json_parser::expect(const char *chars) {
+    skip_whitespace();
+    if (pos == text.size() || !strchr(chars, text[pos])) {
+        throw runtime_error("Invalid benchmark results file.");
+    }
+    return text[pos++];
+}
+
+// Reads the XXXX of a \\uXXXX escape, with pos at the u.
+unsigned json_parser::parse_hex4() {
+    if (pos + 4 >= text.size()) {
+        throw runtime_error("Invalid benchmark results file.");
+    }
+    unsigned rez = 0;
+    for (int i = 1; i <= 4; ++i) {
+        char c = text[pos + i];
+        if (!isxdigit(static_cast<unsigned char>(c))) {
+            throw runtime_error("Invalid benchmark results file.");
+        }
+        rez = rez * 16 + (isdigit(static_cast<unsigned char>(c)) ?
+                          c - '0' : (c | 0x20) - 'a' + 10);
+    }
+    pos += 4;
+    return rez;
+}
+
+string json_parser::parse_string() {
+    expect("\"");
+    string rez;
+    while (pos < text.size() && text[pos] != '"') {
+        if (text[pos] == '\\' && pos + 1 < text.size()) {
+            char c = text[++pos];
+            if (c == 'u') {
+                char32_t code_point = parse_hex4();
+                // Characters outside the BMP are escaped as a surrogate pair.
+                if (code_point >= 0xD800 && code_point < 0xDC00 &&
+                    text.compare(pos + 1, 2, "\\u") == 0) {
+                    pos += 2;
+                    unsigned low = parse_hex4();
+                    if (low < 0xDC00 || low >= 0xE000) {
+                        throw runtime_error(
+                                "Invalid benchmark results file.");
+                    }
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) +
+                                 (low - 0xDC00);
+                } else if (code_point >= 0xD800 && code_point < 0xE000) {
+                    code_point = 0xFFFD;
+                }
+                rez += static_cast<string>(unicode_char(code_point));
+            } else {
+                rez += c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' :
+                       c == 'b' ? '\b' : c == 'f' ? '\f' : c;
+            }
+        } else {
+            rez += text[pos];
+        }
+        ++pos;
+    }
+    expect("\"");
+    return rez;
+}
+
+json_value json_parser::parse() {
+    json_value v;
+    skip_whitespace();
+    char c = pos < text.size() ? text[pos] : 0;
+    if (c == '{') {
+        v.type = json_value::object;
+        ++pos;
+        skip_whitespace();
+        if (pos < text.size() && text[pos] == '}') {
+            ++pos;
+            return v;
+        }
+        do {
+            string key = parse_string();
+            expect(":");
+            v.members.emplace_back(key, parse());
+        } while (expect(",}") == ',');
+    } else if (c == '[') {
+        v.type = json_value::array;
+        ++pos;
+        skip_whitespace();
+        if (pos < text.size() && text[pos] == ']') {
+            ++pos;
+            return v;
+        }
+        do {
+            v.items.push_back(parse());
+        } while (expect(",]") == ',');
+    } else if (c == '"') {
+        v.type = json_value::string_value;
+        v.str = parse_string();
+    } else if (text.compare(pos, 4, "true") == 0 ||
+               text.compare(pos, 5, "false") == 0) {
+        v.type = json_value::boolean;
+        v.num = text[pos] == 't';
+        pos += text[pos] == 't' ? 4 : 5;
+    } else if (text.compare(pos, 4, "null") == 0) {
+        v.type = json_value::null;
+        pos += 4;
+    } else {
+        v.type = json_value::number;
+        const char *start = text.c_str() + pos;
+        char *end;
+        v.num = strtod(start, &end);
+        if (end == start) {
+            throw runtime_error("Invalid benchmark results file.");
+        }
+        pos += end - start;
+    }
+    return v;
+}
+
+static json_value read_json(const string &path) {
+    ifstream ifs(path);
+    if (!ifs.good()) {
+        throw runtime_error("Can't open " + path);
+    }
+    string text((istreambuf_iterator<char>(ifs)),
+                istreambuf_iterator<char>());
+    return json_parser(text).parse();
+}
+
+// Two-sided p-value of the Mann-Whitney U test (normal approximation with
+// continuity correction), which doesn't assume normally distributed times.
+static double mann_whitney_p(const vector<double> &a,
+                             const vector<double> &b) {
+    double n1 = a.size(), n2 = b.size();
+    if (n1 < 2 || n2 < 2) {
+        return 1;
+    }
+    double u = 0;
+    for (unsigned i = 0; i < a.size(); ++i) {
+        for (unsigned j = 0; j < b.size(); ++j) {
+            u += a[i] < b[j] ? 1 : a[i] == b[j] ? 0.5 : 0;
+        }
+    }
+    double mean = n1 * n2 / 2;
+    double sd = sqrt(n1 * n2 * (n1 + n2 + 1) / 12);
+    double z = max(0., fabs(u - mean) - 0.5) / sd;
+    return erfc(z / sqrt(2.));
+}
+
+// Compares the per-repetition ns/byte of the benchmarks in both files.
+// Returns the number of benchmarks that got significantly slower by more
+// than max_slowdown. n_missing receives the number of base benchmarks
+// missing from the new results.
+static int compare_results(const string &base_path, const string &new_path,
+                           double max_slowdown, double alpha,
+                           int *n_missing) {
+    json_value base = read_json(base_path), current = read_json(new_path);
+    const char *keys[] = {"cpu", "compiler", "build_type", "corpus_bytes"};
+    for (unsigned i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+        const json_value &a = base["context"][keys[i]];
+        const json_value &b = current["context"][keys[i]];
+        if (a.str != b.str || a.num != b.num) {
+            cerr << "Warning: results differ in " << keys[i] << '\n';
+        }
+    }
+
+    cout << left << setw(18) << "benchmark" << right << setw(12)
+         << "base ns/B" << setw(12) << "new ns/B" << setw(10) << "change"
+         << setw(10) << "p" << "  verdict\n";
+    int n_regressions = 0;
+    const vector<json_value> &base_benchmarks = base["benchmarks"].items;
+    const vector<json_value> &new_benchmarks = current["benchmarks"].items;
+    for (unsigned i = 0; i < new_benchmarks.size(); ++i) {
+        const json_value &nb = new_benchmarks[i];
+        const json_value *bb = 0;
+        for (unsigned j = 0; j < base_benchmarks.size(); ++j) {
+            if (base_benchmarks[j]["name"].str == nb["name"].str) {
+                bb = &base_benchmarks[j];
+            }
+        }
+        if (!bb) {
+            cout << left << setw(18) << nb["name"].str << string(44, ' ')
+                 << "  new\n";
+            continue;
+        }
+        vector<double> t[2];
+        const json_value *b[2] = {bb, &nb};
+        for (int k = 0; k < 2; ++k) {
+            const vector<json_value> &seconds = (*b[k])["seconds"].items;
+            for (unsigned j = 0; j < seconds.size(); ++j) {
+                t[k].push_back(seconds[j].num * 1e9 / (*b[k])["bytes"].num);
+            }
+            if (t[k].empty()) {
+                throw runtime_error("No repetitions for " + nb["name"].str);
+            }
+        }
+        double base_median = median(t[0]), new_median = median(t[1]);
+        double change = new_median / base_median - 1;
+        double p = mann_whitney_p(t[0], t[1]);
+        const char *verdict = "~";
+        if (p < alpha) {
+            verdict = change < 0 ? "faster" : "slower";
+            if (change > max_slowdown) {
+                verdict = "REGRESSION";
+                ++n_regressions;
+            }
+        }
+        cout << left << setw(18) << nb["name"].str << right << fixed
+             << setprecision(3) << setw(12) << base_median << setw(12)
+             << new_median << setprecision(1) << setw(9) << change * 100
+             << '%' << setprecision(4) << setw(10) << p << "  " << verdict
+             << '\n';
+        cout.unsetf(ios_base::floatfield);
+    }
+    *n_missing = 0;
+    for (unsigned i = 0; i < base_benchmarks.size(); ++i) {
+        const string &name = base_benchmarks[i]["name"].str;
+        bool found = false;
+        for (unsigned j = 0; j < new_benchmarks.size() && !found; ++j) {
+            found = new_benchmarks[j]["name"].str == name;
+        }
+        if (!found) {
+            cout << left << setw(18) << name << string(44, ' ')
+                 << "  MISSING\n";
+            ++*n_missing;
+        }
+    }
+    return n_regressions;
+}
+
+static void write_file(const string &path, const string &contents) {
+    ofstream ofs(path, ios_base::binary);
+    ofs << contents;
+    if (!ofs.good()) {
+        throw runtime_error("Can't write " + path);
+    }
+}
+
+// Paths of the live temp_files, for removing them from a signal handler.
+static const int max_temp_files = 4;
+static char temp_file_paths[max_temp_files][4096];
+
+static void remove_temp_files(int sig) {
+    for (int i = 0; i < max_temp_files; ++i) {
+        if (temp_file_paths[i][0]) {
+            unlink(temp_file_paths[i]);
+        }
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+// Temporary file that is removed when it goes out of scope, or when the
+// benchmark is interrupted with SIGINT or SIGTERM.
+class temp_file {
+public:
+    explicit temp_file(const char *name);
+    ~temp_file();
+    temp_file(const temp_file &) = delete;
+    temp_file &operator=(const temp_file &) = delete;
+
+    const string &path() const;
+private:
+    string file_path;
+    int slot;
+};
+
+temp_file::temp_file(const char *name) : slot(-1) {
+    const char *dir = getenv("TMPDIR");
+    file_path = string(dir ? dir : "/tmp") + "/" + name + "XXXXXX";
+    for (int i = 0; i < max_temp_files && slot == -1; ++i) {
+        if (!temp_file_paths[i][0]) {
+            slot = i;
+        }
+    }
+    if (slot == -1 || file_path.size() >= sizeof(temp_file_paths[0])) {
+        throw runtime_error("Can't create a temporary file.");
+    }
+    int fd = mkstemp(&file_path[0]);
+    if (fd == -1) {
+        throw runtime_error("Can't create a temporary file.");
+    }
+    close(fd);
+    signal(SIGINT, remove_temp_files);
+    signal(SIGTERM, remove_temp_files);
+    strcpy(temp_file_paths[slot], file_path.c_str());
+}
+
+temp_file::~temp_file() {
+    temp_file_paths[slot][0] = 0;
+    remove(file_path.c_str());
+}
+
+const string &temp_file::path() const {
+    return file_path;
+}
+
+static size_t file_size(const string &path) {
+    ifstream ifs(path, ios_base::binary | ios_base::ate);
+    return ifs.tellg();
+}
+
+// Whether the token ends with punctuation, i.e. might end a sentence.
+static bool ends_with_punctuation(const utf8_slice &token) {
+    return !token.empty() &&
+        ((--token.end())->category().bitmask & UC_CATEGORY_MASK_P) != 0;
+}
+
+static void print_usage(const char *program) {
+    cerr << "Usage: " << program
+         << " [--size MB] [--reps N] [--warmup N] [--seed S]\n"
+            "    [--train-epochs N] [--only NAME] [--format table|json]\n"
+            "    [model.txt]\n"
+            "   or: " << program << " compare [--max-slowdown PERCENT]"
+            " [--alpha P]\n"
+            "    base.json new.json\n"
+            "Without a model, one is trained on the generated corpus.\n"
+            "compare exits with 1 if a benchmark got significantly slower\n"
+            "by more than --max-slowdown (5% by default), or is missing\n"
+            "from new.json.\n";
+}
+
+static int compare_main(int argc, char **argv) {
+    double max_slowdown = 5;
+    double alpha = 0.05;
+    vector<string> files;
+    for (int i = 2; i < argc; ++i) {
+        if (!strcmp(argv[i], "--max-slowdown") && i + 1 < argc) {
+            max_slowdown = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--alpha") && i + 1 < argc) {
+            alpha = atof(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            cerr << "Unknown option: " << argv[i] << '\n';
+            return 2;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.size() != 2) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    int n_missing;
+    int n_regressions = compare_results(files[0], files[1],
+                                        max_slowdown / 100, alpha,
+                                        &n_missing);
+    if (n_regressions) {
+        cerr << n_regressions << " regression(s)\n";
+    }
+    if (n_missing) {
+        cerr << n_missing << " benchmark(s) missing from " << files[1]
+             << '\n';
+    }
+    return n_regressions || n_missing ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    try {
+        if (argc > 1 && !strcmp(argv[1], "compare")) {
+            return compare_main(argc, argv);
+        }
+        double size_mb = 4;
+        int reps = 10;
+        int warmup = 2;
+        int train_epochs = 10;
+        unsigned seed = 1;
+        string only;
+        string format = "table";
+        string model_path;
+        for (int i = 1; i < argc; ++i) {
+            if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+                print_usage(argv[0]);
+                return 1;
+            } else if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+                size_mb = atof(argv[++i]);
+            } else if (!strcmp(argv[i], "--reps") && i + 1 < argc) {
+                reps = atoi(argv[++i]);
+            } else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+                warmup = atoi(argv[++i]);
+            } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+                seed = atoi(argv[++i]);
+            } else if (!strcmp(argv[i], "--train-epochs") && i + 1 < argc) {
+                train_epochs = atoi(argv[++i]);
+            } else if (!strcmp(argv[i], "--only") && i + 1 < argc) {
+                only = argv[++i];
+            } else if (!strcmp(argv[i], "--format") && i + 1 < argc) {
+                format = argv[++i];
+            } else if (argv[i][0] == '-') {
+                cerr << "Unknown option: " << argv[i] << '\n';
+                return 1;
+            } else {
+                model_path = argv[i];
+            }
+        }
+        if (size_mb <= 0 || reps < 1 || warmup < 0 || train_epochs < 1 ||
+            (format != "table" && format != "json")) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        bool table = format == "table";
+
+        bench_corpus corpus = generate_corpus(size_mb * 1e6, seed);
+        const string &text = corpus.text;
+        temp_file gold_file("bench_gold");
+        const string &gold_path = gold_file.path();
+        write_file(gold_path, corpus.gold);
+        sbd_train_options train_options;
+        train_options.n_epochs = train_epochs;
+
+        unique_ptr<temp_file> model_file;
+        if (model_path.empty()) {
+            model_file.reset(new temp_file("bench_model"));
+            model_path = model_file->path();
+            sbd_model::train_model(gold_path, "", train_options).save(
+                    model_path);
+        }
+        sbd_model model = sbd_model::load(model_path);
+
+        vector<char32_t> code_points;
+        for (utf8_iterator i(text), e(text.c_str() + text.size()); i < e;) {
+            code_points.push_back(i.dereference_and_increment());
+        }
+        vector<sbd_context> candidates;
+        {
+            sbd_context context;
+            standard_tokenizer tokenizer(text);
+            for (auto i = tokenizer.begin(), e = tokenizer.end(); i != e;
+                 ++i) {
+                context.add_token(*i);
+                if (ends_with_punctuation(context.get_token(0))) {
+                    candidates.push_back(context);
+                }
+            }
+        }
+
+        bench_metadata metadata;
+        {
+            time_t now = time(0);
+            char buf[32];
+            strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+            metadata.date = buf;
+        }
+        metadata.cpu = cpu_name();
+        metadata.compiler = compiler_name();
+        metadata.build_type = build_type();
+        metadata.corpus_bytes = text.size();
+        metadata.seed = seed;
+        metadata.reps = reps;
+        metadata.warmup = warmup;
+        if (table) {
+            cout << "Corpus: " << text.size() << " bytes, "
+                 << corpus.n_sentences << " sentences, seed " << seed
+                 << ", " << reps << " repetitions after " << warmup
+                 << " warm-up runs\n";
+            print_table_header();
+        }
+
+        vector<bench_result> results;
+        auto enabled = [&](const string &name) {
+            return only.empty() || only == name;
+        };
+        auto add_result = [&](const bench_result &r) {
+            results.push_back(r);
+            if (table) {
+                print_result(r);
+            }
+        };
+        if (enabled("utf8_decode")) {
+            add_result(run_bench("utf8_decode", "chars", text.size(),
+                                 warmup, reps, [&]() {
+                size_t n = 0;
+                char32_t sum = 0;
+                for (utf8_iterator i(text), e(text.c_str() + text.size());
+                     i < e; ++n) {
+                    sum += i.dereference_and_increment();
+                }
+                bench_sink += sum;
+                return n;
+            }));
+        }
+        if (enabled("unicode_category")) {
+            add_result(run_bench("unicode_category", "chars", text.size(),
+                                 warmup, reps, [&]() {
+                unsigned bits = 0;
+                for (unsigned i = 0; i < code_points.size(); ++i) {
+                    bits += unicode_char(code_points[i]).category().bitmask;
+                }
+                bench_sink += bits;
+                return code_points.size();
+            }));
+        }
+        if (enabled("tokenizer")) {
+            add_result(run_bench("tokenizer", "tokens", text.size(),
+                                 warmup, reps, [&]() {
+                standard_tokenizer tokenizer(text);
+                size_t n = 0;
+                for (auto i = tokenizer.begin(), e = tokenizer.end(); i != e;
+                     ++i) {
+                    ++n;
+                }
+                return n;
+            }));
+        }
+        if (enabled("get_context")) {
+            add_result(run_bench("get_context", "contexts", text.size(),
+                                 warmup, reps, [&]() {
+                vector<pair<unsigned, double>> features;
+                size_t n_features = 0;
+                for (unsigned i = 0; i < candidates.size(); ++i) {
+                    sbd_model_inspector::get_features(model, candidates[i],
+                                                      &features);
+                    n_features += features.size();
+                }
+                bench_sink += n_features;
+                return candidates.size();
+            }));
+        }
+        if (enabled("is_eos")) {
+            add_result(run_bench("is_eos", "contexts", text.size(),
+                                 warmup, reps, [&]() {
+                size_t n_eos = 0;
+                for (unsigned i = 0; i < candidates.size(); ++i) {
+                    n_eos += model.is_eos(candidates[i]);
+                }
+                bench_sink += n_eos;
+                return candidates.size();
+            }));
+        }
+        if (enabled("model_load")) {
+            add_result(run_bench("model_load", "loads",
+                                 file_size(model_path), warmup, reps, [&]() {
+                sbd_model loaded = sbd_model::load(model_path);
+                return 1;
+            }));
+        }
+        if (enabled("text_sentences")) {
+            add_result(run_bench("text_sentences", "sentences",
+                                 text.size(), warmup, reps, [&]() {
+                text_sentences ts(text, model);
+                size_t n = 0;
+                for (auto i = ts.begin(), e = ts.end(); i != e; ++i) {
+                    ++n;
+                }
+                return n;
+            }));
+        }
+        if (enabled("stream_sentences")) {
+            // Also checks that the result is the same as text_sentences, and
+            // that sentences stay valid until the next write, as
+            // sentence_splitter's writer relies on.
+            vector<string> expected;
+            for (auto sentence : text_sentences(text, model)) {
+                expected.push_back(sentence);
+            }
+            add_result(run_bench("stream_sentences", "sentences",
+                                 text.size(), warmup, reps, [&]() {
+                stream_sentences ss(model);
+                vector<utf8_slice> sentences;
+                size_t n = 0;
+                auto check = [&]() {
+                    for (unsigned i = 0; i < sentences.size(); ++i, ++n) {
+                        if (n >= expected.size() ||
+                            sentences[i].string() != expected[n]) {
+                            throw runtime_error("stream_sentences differs "
+                                "from text_sentences at sentence " +
+                                to_string(n + 1) + ".");
+                        }
+                    }
+                    sentences.clear();
+                };
+                auto add = [&](const utf8_slice &sentence) {
+                    sentences.push_back(sentence);
+                };
+                const size_t chunk_size = 1 << 20;
+                for (size_t pos = 0; pos < text.size(); pos += chunk_size) {
+                    ss.write(text.data() + pos,
+                             min(chunk_size, text.size() - pos), add);
+                    check();
+                }
+                ss.finish(add);
+                check();
+                if (n != expected.size()) {
+                    throw runtime_error("stream_sentences missed "
+                                        "sentences.");
+                }
+                return n;
+            }));
+        }
+        if (enabled("train_model")) {
+            // Training is slow, so it isn't warmed up.
+            add_result(run_bench("train_model", "sentences",
+                                 corpus.gold.size(), 0, reps, [&]() {
+                sbd_model::train_model(gold_path, "", train_options);
+                return corpus.n_sentences;
+            }));
+        }
+        if (enabled("train_model_dcd")) {
+            sbd_train_options dcd_options = train_options;
+            dcd_options.optimizer = sbd_optimizer::dual_coordinate_descent;
+            add_result(run_bench("train_model_dcd", "sentences",
+                                 corpus.gold.size(), 0, reps, [&]() {
+                sbd_model::train_model(gold_path, "", dcd_options);
+                return corpus.n_sentences;
+            }));
+        }
+        if (!table) {
+            print_json(metadata, results);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << '\n';
+        return 1;
+    }
+}
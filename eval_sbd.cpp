@@ -30,10 +30,17 @@ either expressed or implied, of Frane Saric.
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <memory>
 #include <stdexcept>
 #include <iomanip>
+#include <cstring>
 
 #include <libsentences/standard_tokenizer.h>
+#include <libsentences/text_sentences.h>
+#include <libsentences/sbd_model.h>
+#include <libsentences/mapped_file.h>
+#include <libsentences/compressed_input.h>
 
 using namespace std;
 using namespace libsentences;
@@ -45,6 +52,11 @@ static int cnt_lines(const utf8_iterator i,
 }
 
 static void read_file(const char *path, string &result) {
+    if (compressed_input::is_compressed(path)) {
+        result.clear();
+        compressed_input(path).read_all(&result);
+        return;
+    }
     ifstream ifs(path);
     if (!ifs.good()) {
         cerr << "Can't open " << path << '\n';
@@ -89,12 +101,21 @@ static bool files_token_equal(const string &path1, const string &path2) {
 static vector<int> get_newline_positions(const string &path) {
     vector<int> positions;
     int cur_pos = 0;
-    string line;
-    ifstream ifs(path);
-    if (!ifs.good()) {
-        throw runtime_error("Can't open file " + path);
+    ifstream file;
+    istringstream decompressed;
+    istream *is = &file;
+    if (compressed_input::is_compressed(path)) {
+        string text;
+        compressed_input(path).read_all(&text);
+        decompressed.str(text);
+        is = &decompressed;
+    } else {
+        file.open(path);
+        if (!file.good()) {
+            throw runtime_error("Can't open file " + path);
+        }
     }
-    for (string line; getline(ifs, line);) {
+    for (string line; getline(*is, line);) {
         int cnt_line_tokens = 0;
         auto &&tokens = standard_tokenizer(line);
         cnt_line_tokens += distance(tokens.begin(), tokens.end());
@@ -106,6 +127,8 @@ static vector<int> get_newline_positions(const string &path) {
     return move(positions);
 }
 
+static void print_scores(int tp, int fp, int fn);
+
 static void evaluate(const vector<int> &gold_pos,
                      const vector<int> &test_pos,
                      vector<int> *fp_list,
@@ -152,7 +175,10 @@ static void evaluate(const vector<int> &gold_pos,
             fp_list->push_back(*test_it);
         }
     }
+    print_scores(tp, fp, fn);
+}
 
+static void print_scores(int tp, int fp, int fn) {
     double recall = static_cast<double>(tp) / (tp + fn);
     double precision = static_cast<double>(tp) / (tp + fp);
     double f1 = static_cast<double>(2 * tp) / (2 * tp + fp + fn);
@@ -194,14 +220,121 @@ static void print_list(const vector<int> &list, const string &path) {
     cout << '\n';
 }
 
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+           c == '\v';
+}
+
+// Prints the two words before and the word after each break. Unlike
+// print_list, these are whitespace separated words, not tokens.
+static void print_break_list(const vector<const char *> &list,
+                             const utf8_slice &text) {
+    const char *begin = text.ptr(), *end = begin + text.size();
+    for (unsigned i = 0; i < list.size(); ++i) {
+        const char *first = list[i];
+        for (int words = 0; words < 2; ++words) {
+            while (first > begin && is_space(first[-1])) {
+                --first;
+            }
+            while (first > begin && !is_space(first[-1])) {
+                --first;
+            }
+        }
+        const char *last = list[i];
+        while (last < end && is_space(*last)) {
+            ++last;
+        }
+        while (last < end && !is_space(*last)) {
+            ++last;
+        }
+        string before(first, list[i]), after(list[i], last);
+        replace(before.begin(), before.end(), '\n', ' ');
+        replace(after.begin(), after.end(), '\n', ' ');
+        cout << i + 1 << ". " << before << " |" << after << '\n';
+    }
+    cout << '\n';
+}
+
+// Splits the gold text with the model and compares the result with the gold
+// line breaks in one pass over the mapped file. Newlines are ignored by the
+// splitter and the model only sees tokens, so this splits exactly like the
+// gold sentences joined into one line. Sentences end with a token, so a
+// predicted break is correct iff the whitespace after it has a newline.
+static void evaluate_model(const string &model_path, const string &gold_path,
+                           bool print_fp, bool print_fn) {
+    auto model = sbd_model::load(model_path);
+    // Compressed gold text is decompressed into memory first.
+    string decompressed;
+    unique_ptr<mapped_file> gold;
+    utf8_slice text;
+    if (compressed_input::is_compressed(gold_path)) {
+        compressed_input(gold_path).read_all(&decompressed);
+        text = utf8_slice(decompressed.data(),
+                          static_cast<int64_t>(decompressed.size()));
+    } else {
+        gold.reset(new mapped_file(gold_path));
+        gold->advise_sequential();
+        text = utf8_slice(gold->data(), static_cast<int64_t>(gold->size()));
+    }
+    text_sentences ts(text, model, sbd_eol_handling::ignore_eol);
+
+    int tp = 0, fp = 0, fn = 0;
+    vector<const char *> fp_list, fn_list;
+    const char *prev_end = 0;
+    for (text_sentences::iterator i = ts.begin(), e = ts.end(); i != e;
+         ++i) {
+        utf8_slice sentence = *i;
+        const char *first = sentence.ptr();
+        const char *last = first + sentence.size();
+        if (prev_end) {
+            if (memchr(prev_end, '\n', first - prev_end)) {
+                ++tp;
+            } else {
+                ++fp;
+                fp_list.push_back(prev_end);
+            }
+        }
+        // Gold breaks inside the sentence were missed. A run of empty lines
+        // is a single break.
+        for (const char *p = first;
+             (p = static_cast<const char *>(memchr(p, '\n', last - p)));) {
+            const char *token_end = p;
+            while (is_space(token_end[-1])) {
+                --token_end;
+            }
+            ++fn;
+            fn_list.push_back(token_end);
+            while (p < last && is_space(*p)) {
+                ++p;
+            }
+        }
+        prev_end = last;
+    }
+    if (prev_end) { // end of text
+        ++tp;
+    }
+    print_scores(tp, fp, fn);
+
+    if (print_fp) {
+        cout << "\nFP list:\n";
+        print_break_list(fp_list, text);
+    }
+    if (print_fn) {
+        cout << "\nFN list:\n";
+        print_break_list(fn_list, text);
+    }
+}
+
 int main(int argc, char **argv) {
     try {
-        string gold_file, test_file;
+        string gold_file, test_file, model_file;
         bool print_fp = false, print_fn = false;
         if (argc <= 1 || !strcmp(argv[1], "-h") ||
                          !strcmp(argv[1], "--help")) {
             cerr << "Usage: " << argv[0]
-                 << " [--print-fp] [--print-fn] gold.txt test.txt\n";
+                 << " [--print-fp] [--print-fn] gold.txt test.txt\n"
+                 << "   or: " << argv[0]
+                 << " [--print-fp] [--print-fn] --model model.txt gold.txt\n";
             return 1;
         }
         for (int i = 1; i < argc; ++i) {
@@ -209,6 +342,8 @@ int main(int argc, char **argv) {
                 print_fp = true;
             } else if (!strcmp(argv[i], "--print-fn")) {
                 print_fn = true;
+            } else if (!strcmp(argv[i], "--model") && i + 1 < argc) {
+                model_file = argv[++i];
             } else if (argv[i][0] == '-') {
                 cerr << "Unknown option: " << argv[i] << '\n';
                 return 1;
@@ -218,6 +353,14 @@ int main(int argc, char **argv) {
                 test_file = argv[i];
             }
         }
+        if (!model_file.empty()) {
+            if (gold_file.empty() || !test_file.empty()) {
+                throw runtime_error(
+                        "You must specify only gold_file with --model.");
+            }
+            evaluate_model(model_file, gold_file, print_fp, print_fn);
+            return 0;
+        }
         if (gold_file.empty() || test_file.empty()) {
             throw runtime_error(
                     "You must specify both gold_file and test_file.");
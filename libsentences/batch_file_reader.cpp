@@ -0,0 +1,434 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#include <libsentences/batch_file_reader.h>
+#include <libsentences/bounded_queue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef LIBSENTENCES_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+using namespace std;
+
+namespace libsentences {
+
+static string error_message(const string &what, const string &path,
+                            int error) {
+    return what + ' ' + path + ": " + strerror(error);
+}
+
+// Appends everything left in fd to text.
+static bool read_rest(int fd, string *text) {
+    size_t len = text->size();
+    for (;;) {
+        text->resize(max<size_t>(2 * len, len + 4096));
+        ssize_t n = ::read(fd, &(*text)[len], text->size() - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            text->resize(len);
+            return n == 0;
+        }
+        len += n;
+    }
+}
+
+static void read_blocking(batch_file_reader::document *doc) {
+    int fd = open(doc->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        doc->error = error_message("Can't open", doc->path, errno);
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        doc->text.reserve(st.st_size + 1);
+    }
+    if (!read_rest(fd, &doc->text)) {
+        doc->error = error_message("Can't read", doc->path, errno);
+    }
+    close(fd);
+}
+
+#ifdef LIBSENTENCES_HAVE_IO_URING
+
+// Minimal io_uring submission and completion rings on top of the raw
+// system calls.
+class io_ring {
+public:
+    // Throws if the kernel doesn't support io_uring with the needed
+    // operations.
+    explicit io_ring(unsigned entries);
+    io_ring(const io_ring &) = delete;
+    io_ring &operator=(const io_ring &) = delete;
+    ~io_ring();
+
+    // Zeroed entry to fill in, null if the submission ring is full.
+    io_uring_sqe *get_sqe();
+    // Submits the filled entries and waits until n completions arrived,
+    // passing each of them to f.
+    template<class F>
+    void submit_and_reap(unsigned n, F f);
+private:
+    int enter(unsigned to_submit, unsigned min_complete);
+    void release();
+
+    int fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_cqe *cqes;
+    unsigned sqe_tail;
+    unsigned to_submit;
+};
+
+io_ring::io_ring(unsigned entries) :
+    fd(-1), sq_ring(MAP_FAILED), cq_ring(MAP_FAILED), sqes(0),
+    sqe_tail(0), to_submit(0) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) {
+        throw runtime_error("io_uring isn't available.");
+    }
+    // Kernels without this feature (before 5.6) lack openat, read and
+    // close operations.
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        close(fd);
+        throw runtime_error("io_uring is too old.");
+    }
+    sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size = cq_ring_size = max(sq_ring_size, cq_ring_size);
+    }
+    sq_ring = mmap(0, sq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring != MAP_FAILED) {
+        cq_ring = p.features & IORING_FEAT_SINGLE_MMAP ? sq_ring :
+            mmap(0, cq_ring_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    }
+    sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    void *s = MAP_FAILED;
+    if (cq_ring != MAP_FAILED) {
+        s = mmap(0, sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    }
+    if (s == MAP_FAILED) {
+        release();
+        throw runtime_error("Can't map the io_uring rings.");
+    }
+    sqes = static_cast<io_uring_sqe *>(s);
+
+    char *sq = static_cast<char *>(sq_ring);
+    sq_head = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    sq_entries = p.sq_entries;
+    char *cq = static_cast<char *>(cq_ring);
+    cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+    sqe_tail = *sq_tail;
+}
+
+io_ring::~io_ring() {
+    release();
+}
+
+void io_ring::release() {
+    if (sqes) {
+        munmap(sqes, sqes_size);
+    }
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    if (sq_ring != MAP_FAILED) {
+        munmap(sq_ring, sq_ring_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+io_uring_sqe *io_ring::get_sqe() {
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sqe_tail - head >= sq_entries) {
+        return 0;
+    }
+    unsigned idx = sqe_tail & *sq_mask;
+    sq_array[idx] = idx;
+    ++sqe_tail;
+    ++to_submit;
+    io_uring_sqe *sqe = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int io_ring::enter(unsigned n_submit, unsigned min_complete) {
+    for (;;) {
+        int rez = syscall(__NR_io_uring_enter, fd, n_submit, min_complete,
+                          min_complete ? IORING_ENTER_GETEVENTS : 0, 0, 0);
+        if (rez >= 0 || errno != EINTR) {
+            return rez;
+        }
+    }
+}
+
+template<class F>
+void io_ring::submit_and_reap(unsigned n, F f) {
+    __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+    while (to_submit) {
+        int submitted = enter(to_submit, 0);
+        if (submitted < 0) {
+            throw runtime_error(string("io_uring_enter failed: ") +
+                                strerror(errno));
+        }
+        to_submit -= submitted;
+    }
+    while (n) {
+        unsigned head = *cq_head;
+        if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            if (enter(0, 1) < 0) {
+                throw runtime_error(string("io_uring_enter failed: ") +
+                                    strerror(errno));
+            }
+            continue;
+        }
+        io_uring_cqe cqe = cqes[head & *cq_mask];
+        __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+        f(cqe);
+        --n;
+    }
+}
+
+#endif
+
+batch_file_reader::batch_file_reader(unsigned batch_size_,
+                                     int n_fallback_threads_) :
+    batch_size(max(batch_size_, 1u)),
+    n_fallback_threads(max(n_fallback_threads_, 1)),
+    io_uring_available(false) {
+#ifdef LIBSENTENCES_HAVE_IO_URING
+    try {
+        io_ring ring(1);
+        io_uring_available = true;
+    } catch (const runtime_error &) {
+    }
+#endif
+}
+
+bool batch_file_reader::uses_io_uring() const {
+    return io_uring_available;
+}
+
+void batch_file_reader::read(const vector<string> &paths,
+                             const document_callback &f) const {
+    if (io_uring_available) {
+        read_io_uring(paths, f);
+    } else {
+        read_threads(paths, f);
+    }
+}
+
+void batch_file_reader::read_io_uring(const vector<string> &paths,
+                                      const document_callback &f) const {
+#ifdef LIBSENTENCES_HAVE_IO_URING
+    // Each batch takes three round trips: open all files, read them and
+    // close them.
+    io_ring ring(batch_size);
+    vector<document> docs;
+    vector<int> fds;
+    for (size_t first = 0; first < paths.size(); first += batch_size) {
+        unsigned n = min<size_t>(batch_size, paths.size() - first);
+        docs.resize(n);
+        fds.assign(n, -1);
+        for (unsigned i = 0; i < n; ++i) {
+            docs[i].index = first + i;
+            docs[i].path = paths[first + i];
+            docs[i].text.clear();
+            docs[i].error.clear();
+            io_uring_sqe *sqe = ring.get_sqe();
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<uintptr_t>(docs[i].path.c_str());
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            sqe->user_data = i;
+        }
+        ring.submit_and_reap(n, [&](const io_uring_cqe &cqe) {
+            document &doc = docs[cqe.user_data];
+            if (cqe.res < 0) {
+                doc.error = error_message("Can't open", doc.path, -cqe.res);
+            } else {
+                fds[cqe.user_data] = cqe.res;
+            }
+        });
+
+        unsigned n_open = 0;
+        for (unsigned i = 0; i < n; ++i) {
+            if (fds[i] == -1) {
+                continue;
+            }
+            docs[i].text.resize(initial_read_size);
+            io_uring_sqe *sqe = ring.get_sqe();
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fds[i];
+            sqe->addr = reinterpret_cast<uintptr_t>(&docs[i].text[0]);
+            sqe->len = initial_read_size;
+            sqe->off = 0;
+            sqe->user_data = i;
+            ++n_open;
+        }
+        ring.submit_and_reap(n_open, [&](const io_uring_cqe &cqe) {
+            document &doc = docs[cqe.user_data];
+            if (cqe.res < 0) {
+                doc.text.clear();
+                doc.error = error_message("Can't read", doc.path, -cqe.res);
+                return;
+            }
+            doc.text.resize(cqe.res);
+            // The file may be larger than the first read.
+            if (size_t(cqe.res) == initial_read_size &&
+                (lseek(fds[cqe.user_data], cqe.res, SEEK_SET) == -1 ||
+                 !read_rest(fds[cqe.user_data], &doc.text))) {
+                doc.text.clear();
+                doc.error = error_message("Can't read", doc.path, errno);
+            }
+        });
+
+        for (unsigned i = 0; i < n; ++i) {
+            if (fds[i] != -1) {
+                io_uring_sqe *sqe = ring.get_sqe();
+                sqe->opcode = IORING_OP_CLOSE;
+                sqe->fd = fds[i];
+                sqe->user_data = i;
+            }
+        }
+        ring.submit_and_reap(n_open, [](const io_uring_cqe &) { });
+
+        for (unsigned i = 0; i < n; ++i) {
+            f(docs[i]);
+        }
+    }
+#else
+    read_threads(paths, f);
+#endif
+}
+
+void batch_file_reader::read_threads(const vector<string> &paths,
+                                     const document_callback &f) const {
+    typedef unique_ptr<document> document_ptr;
+    // Threads don't read more than batch_size files ahead of the next one
+    // to pass on, so the queue never fills up and the reordering is bounded.
+    bounded_queue<document_ptr> done(batch_size);
+    atomic<size_t> next(0), n_passed(0);
+    atomic<bool> stopped(false);
+    vector<thread> threads;
+    for (int t = 0; t < n_fallback_threads; ++t) {
+        threads.emplace_back([&]() {
+            for (;;) {
+                size_t i = next.fetch_add(1);
+                if (i >= paths.size()) {
+                    return;
+                }
+                while (i >= n_passed.load(memory_order_acquire) +
+                            batch_size) {
+                    if (stopped.load()) {
+                        return;
+                    }
+                    this_thread::sleep_for(chrono::microseconds(100));
+                }
+                document_ptr doc(new document);
+                doc->index = i;
+                doc->path = paths[i];
+                read_blocking(doc.get());
+                done.push(move(doc));
+            }
+        });
+    }
+    map<size_t, document_ptr> pending;
+    try {
+        for (size_t i = 0; i < paths.size(); ++i) {
+            map<size_t, document_ptr>::iterator it;
+            while ((it = pending.find(i)) == pending.end()) {
+                document_ptr doc;
+                done.pop(&doc);
+                size_t index = doc->index;
+                pending[index] = move(doc);
+            }
+            f(*it->second);
+            pending.erase(it);
+            n_passed.store(i + 1, memory_order_release);
+        }
+    } catch (...) {
+        // No thread waits for the queue: at most batch_size documents are
+        // read but not passed on.
+        next = paths.size();
+        stopped = true;
+        for (size_t t = 0; t < threads.size(); ++t) {
+            threads[t].join();
+        }
+        throw;
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+}
+
+}
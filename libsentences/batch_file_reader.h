@@ -0,0 +1,85 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#ifndef LIBSENTENCES__BATCH_FILE_READER_H
+#define LIBSENTENCES__BATCH_FILE_READER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+namespace libsentences {
+
+// Reads many small files into memory. On Linux, opens and reads of a batch
+// of files are submitted together through io_uring, so the system call cost
+// per file is close to zero. Where io_uring isn't available it falls back to
+// a pool of threads doing blocking reads.
+class batch_file_reader {
+public:
+    struct document {
+        // Position of the file in the list given to read.
+        size_t index;
+        std::string path;
+        std::string text;
+        // Set instead of text if the file couldn't be read.
+        std::string error;
+    };
+    typedef std::function<void(document &)> document_callback;
+
+    explicit batch_file_reader(unsigned batch_size = 256,
+                               int n_fallback_threads = 4);
+
+    // Reads all files, calling f from the calling thread for each of them
+    // in order. The document can be modified, e.g. to take its text. If f
+    // throws, reading stops and the exception is passed on.
+    void read(const std::vector<std::string> &paths,
+              const document_callback &f) const;
+
+    // Whether read will use io_uring (it is supported by the build and the
+    // kernel).
+    bool uses_io_uring() const;
+
+    // Files larger than this are finished with ordinary reads.
+    static const size_t initial_read_size = 1 << 15;
+private:
+    void read_io_uring(const std::vector<std::string> &paths,
+                       const document_callback &f) const;
+    void read_threads(const std::vector<std::string> &paths,
+                      const document_callback &f) const;
+
+    unsigned batch_size;
+    int n_fallback_threads;
+    bool io_uring_available;
+};
+
+}
+
+#endif
@@ -0,0 +1,88 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#ifndef LIBSENTENCES__BLOCKING_QUEUE_H
+#define LIBSENTENCES__BLOCKING_QUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+namespace libsentences {
+
+// Queue of limited size whose push and pop sleep on a condition variable
+// while it is full or empty. Unlike bounded_queue, waiting costs no CPU, so
+// it suits threads that are idle most of the time.
+template<class T>
+class blocking_queue {
+public:
+    explicit blocking_queue(size_t capacity);
+    blocking_queue(const blocking_queue &) = delete;
+    blocking_queue &operator=(const blocking_queue &) = delete;
+
+    void push(T value);
+    void pop(T *value);
+private:
+    std::deque<T> items;
+    size_t capacity;
+    std::mutex m;
+    std::condition_variable not_empty, not_full;
+};
+
+template<class T>
+blocking_queue<T>::blocking_queue(size_t capacity_) :
+    capacity(capacity_ ? capacity_ : 1) {
+}
+
+template<class T>
+void blocking_queue<T>::push(T value) {
+    {
+        std::unique_lock<std::mutex> lock(m);
+        not_full.wait(lock, [&]() { return items.size() < capacity; });
+        items.push_back(std::move(value));
+    }
+    not_empty.notify_one();
+}
+
+template<class T>
+void blocking_queue<T>::pop(T *value) {
+    {
+        std::unique_lock<std::mutex> lock(m);
+        not_empty.wait(lock, [&]() { return !items.empty(); });
+        *value = std::move(items.front());
+        items.pop_front();
+    }
+    not_full.notify_one();
+}
+
+}
+
+#endif
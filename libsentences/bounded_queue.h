@@ -0,0 +1,159 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#ifndef LIBSENTENCES__BOUNDED_QUEUE_H
+#define LIBSENTENCES__BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+
+namespace libsentences {
+
+// Lock-free queue of fixed capacity for any number of producers and
+// consumers (Dmitry Vyukov's bounded MPMC queue). Each cell carries a
+// sequence number telling whether it is ready for the next push or pop.
+template<class T>
+class bounded_queue {
+public:
+    // The capacity is rounded up to a power of two.
+    explicit bounded_queue(size_t capacity);
+    bounded_queue(const bounded_queue &) = delete;
+    bounded_queue &operator=(const bounded_queue &) = delete;
+
+    // Return false instead of waiting when the queue is full or empty.
+    bool try_push(T &value);
+    bool try_pop(T *value);
+
+    // Wait (spinning, then sleeping) while the queue is full or empty.
+    void push(T value);
+    void pop(T *value);
+private:
+    struct cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static void backoff(int *spins);
+
+    std::unique_ptr<cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> push_pos;
+    alignas(64) std::atomic<size_t> pop_pos;
+};
+
+template<class T>
+bounded_queue<T>::bounded_queue(size_t capacity) : mask(1) {
+    while (mask < capacity) {
+        mask *= 2;
+    }
+    cells.reset(new cell[mask]);
+    for (size_t i = 0; i < mask; ++i) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    --mask;
+    push_pos.store(0, std::memory_order_relaxed);
+    pop_pos.store(0, std::memory_order_relaxed);
+}
+
+template<class T>
+bool bounded_queue<T>::try_push(T &value) {
+    size_t pos = push_pos.load(std::memory_order_relaxed);
+    for (;;) {
+        cell &c = cells[pos & mask];
+        size_t seq = c.sequence.load(std::memory_order_acquire);
+        ptrdiff_t diff = ptrdiff_t(seq) - ptrdiff_t(pos);
+        if (diff == 0) {
+            if (push_pos.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+                c.value = std::move(value);
+                c.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = push_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template<class T>
+bool bounded_queue<T>::try_pop(T *value) {
+    size_t pos = pop_pos.load(std::memory_order_relaxed);
+    for (;;) {
+        cell &c = cells[pos & mask];
+        size_t seq = c.sequence.load(std::memory_order_acquire);
+        ptrdiff_t diff = ptrdiff_t(seq) - ptrdiff_t(pos + 1);
+        if (diff == 0) {
+            if (pop_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+                *value = std::move(c.value);
+                c.sequence.store(pos + mask + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = pop_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template<class T>
+void bounded_queue<T>::backoff(int *spins) {
+    if (++*spins < 64) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+template<class T>
+void bounded_queue<T>::push(T value) {
+    int spins = 0;
+    while (!try_push(value)) {
+        backoff(&spins);
+    }
+}
+
+template<class T>
+void bounded_queue<T>::pop(T *value) {
+    int spins = 0;
+    while (!try_pop(value)) {
+        backoff(&spins);
+    }
+}
+
+}
+
+#endif
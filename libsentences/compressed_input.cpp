@@ -0,0 +1,431 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#include <libsentences/compressed_input.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifdef LIBSENTENCES_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef LIBSENTENCES_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+namespace libsentences {
+
+enum class compression {
+    none,
+    gzip,
+    zstd
+};
+
+static compression detect_compression(const unsigned char *magic,
+                                      size_t len) {
+    if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return compression::gzip;
+    }
+    if (len >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+        magic[2] == 0x2f && magic[3] == 0xfd) {
+        return compression::zstd;
+    }
+    return compression::none;
+}
+
+namespace {
+
+struct block {
+    vector<char> bytes;
+    size_t size;
+    // The last block of the input, possibly with an error instead of the
+    // rest of it.
+    bool last;
+    string error;
+};
+
+// Produces the decompressed bytes of a file or a buffer, one buffer at a
+// time.
+class decompressor {
+public:
+    explicit decompressor(FILE *f_) : f(f_), buffer(1 << 18),
+                                      in(&buffer[0]), in_pos(0), in_len(0) {
+    }
+    virtual ~decompressor() {
+    }
+    // Fills up to len bytes, returning 0 at the end.
+    virtual size_t fill(char *p, size_t len) = 0;
+    // Bytes already read from the file, consumed before the rest of it.
+    void unread(const void *p, size_t len) {
+        memcpy(&buffer[0], p, len);
+        in = &buffer[0];
+        in_pos = 0;
+        in_len = len;
+    }
+    // Makes [p, p + len) the whole input, without a file.
+    void set_input(const char *p, size_t len) {
+        in = p;
+        in_pos = 0;
+        in_len = len;
+    }
+protected:
+    // Makes sure there is unread compressed input; false at the end.
+    bool refill() {
+        if (in_pos == in_len && f) {
+            in = &buffer[0];
+            in_len = fread(&buffer[0], 1, buffer.size(), f);
+            in_pos = 0;
+            if (ferror(f)) {
+                throw runtime_error("Read failed.");
+            }
+        }
+        return in_pos != in_len;
+    }
+
+    FILE *f;
+    vector<char> buffer;
+    const char *in;
+    size_t in_pos, in_len;
+};
+
+class plain_reader : public decompressor {
+public:
+    explicit plain_reader(FILE *f) : decompressor(f) {
+    }
+    size_t fill(char *p, size_t len) {
+        size_t n = 0;
+        while (n < len && refill()) {
+            size_t k = min(len - n, in_len - in_pos);
+            memcpy(p + n, &in[in_pos], k);
+            in_pos += k;
+            n += k;
+        }
+        return n;
+    }
+};
+
+#ifdef LIBSENTENCES_HAVE_ZLIB
+class gzip_reader : public decompressor {
+public:
+    explicit gzip_reader(FILE *f) : decompressor(f), ended(false) {
+        memset(&zs, 0, sizeof(zs));
+        // 32 detects the gzip header.
+        if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+            throw runtime_error("Can't initialize zlib.");
+        }
+    }
+    ~gzip_reader() {
+        inflateEnd(&zs);
+    }
+    size_t fill(char *p, size_t len) {
+        size_t n = 0;
+        while (n < len && !ended) {
+            if (!refill()) {
+                throw runtime_error("Truncated gzip input.");
+            }
+            zs.next_in = reinterpret_cast<Bytef *>(
+                    const_cast<char *>(in + in_pos));
+            zs.avail_in = in_len - in_pos;
+            zs.next_out = reinterpret_cast<Bytef *>(p + n);
+            zs.avail_out = len - n;
+            int rez = inflate(&zs, Z_NO_FLUSH);
+            n = len - zs.avail_out;
+            in_pos = in_len - zs.avail_in;
+            if (rez == Z_STREAM_END) {
+                // Concatenated gzip files decompress to their
+                // concatenation.
+                if (refill()) {
+                    inflateReset(&zs);
+                } else {
+                    ended = true;
+                }
+            } else if (rez != Z_OK && rez != Z_BUF_ERROR) {
+                throw runtime_error(string("gzip: ") +
+                                    (zs.msg ? zs.msg : "invalid data"));
+            }
+        }
+        return n;
+    }
+private:
+    z_stream zs;
+    bool ended;
+};
+#endif
+
+#ifdef LIBSENTENCES_HAVE_ZSTD
+class zstd_reader : public decompressor {
+public:
+    explicit zstd_reader(FILE *f) : decompressor(f),
+                                    ds(ZSTD_createDStream()),
+                                    frame_done(true) {
+        if (!ds) {
+            throw runtime_error("Can't initialize zstd.");
+        }
+        ZSTD_initDStream(ds);
+    }
+    ~zstd_reader() {
+        ZSTD_freeDStream(ds);
+    }
+    size_t fill(char *p, size_t len) {
+        ZSTD_outBuffer out = {p, len, 0};
+        while (out.pos < out.size) {
+            if (!refill()) {
+                if (!frame_done) {
+                    throw runtime_error("Truncated zstd input.");
+                }
+                break;
+            }
+            ZSTD_inBuffer input = {in + in_pos, in_len - in_pos, 0};
+            size_t rez = ZSTD_decompressStream(ds, &out, &input);
+            in_pos += input.pos;
+            if (ZSTD_isError(rez)) {
+                throw runtime_error(string("zstd: ") +
+                                    ZSTD_getErrorName(rez));
+            }
+            // Zero at the end of a frame.
+            frame_done = rez == 0;
+        }
+        return out.pos;
+    }
+private:
+    ZSTD_DStream *ds;
+    bool frame_done;
+};
+#endif
+
+// Throws if this build can't decompress c.
+decompressor *new_decompressor(compression c, FILE *f,
+                               const string &name) {
+    switch (c) {
+    case compression::gzip:
+#ifdef LIBSENTENCES_HAVE_ZLIB
+        return new gzip_reader(f);
+#else
+        throw runtime_error(name + " is gzip compressed, but this build "
+                            "has no zlib support.");
+#endif
+    case compression::zstd:
+#ifdef LIBSENTENCES_HAVE_ZSTD
+        return new zstd_reader(f);
+#else
+        throw runtime_error(name + " is zstd compressed, but this build "
+                            "has no zstd support.");
+#endif
+    default:
+        return new plain_reader(f);
+    }
+}
+
+}
+
+// The producer fills the blocks of a ring after the n_filled ones starting
+// at head, the reader reads them from head and hands them back.
+class compressed_input::private_data {
+public:
+    static const int n_blocks = 4;
+    static const size_t block_size = 1 << 20;
+
+    private_data() : f(0), ring(n_blocks), head(0), n_filled(0), stop(false),
+                     pos(0) {
+        for (int i = 0; i < n_blocks; ++i) {
+            ring[i].bytes.resize(block_size);
+        }
+    }
+
+    void produce();
+
+    FILE *f;
+    unique_ptr<decompressor> source;
+    vector<block> ring;
+    int head, n_filled;
+    bool stop;
+    mutex m;
+    condition_variable block_filled, block_freed;
+    thread producer;
+    // Position in ring[head].
+    size_t pos;
+};
+
+void compressed_input::private_data::produce() {
+    for (int i = 0; ; i = (i + 1) % n_blocks) {
+        {
+            unique_lock<mutex> lock(m);
+            block_freed.wait(lock, [&]() {
+                return n_filled < n_blocks || stop;
+            });
+            if (stop) {
+                return;
+            }
+        }
+        block &b = ring[i];
+        b.last = false;
+        try {
+            b.size = source->fill(&b.bytes[0], b.bytes.size());
+            b.last = b.size < b.bytes.size();
+        } catch (const exception &e) {
+            b.size = 0;
+            b.last = true;
+            b.error = e.what();
+        }
+        {
+            lock_guard<mutex> lock(m);
+            ++n_filled;
+        }
+        block_filled.notify_one();
+        if (b.last) {
+            return;
+        }
+    }
+}
+
+compressed_input::compressed_input(const string &path) :
+    data(new private_data) {
+    data->f = path == "-" ? stdin : fopen(path.c_str(), "rb");
+    if (!data->f) {
+        throw runtime_error("Can't open " + path);
+    }
+    unsigned char magic[4];
+    size_t n = fread(magic, 1, sizeof(magic), data->f);
+    compression c = detect_compression(magic, n);
+    try {
+        data->source.reset(new_decompressor(c, data->f, path));
+    } catch (...) {
+        if (data->f != stdin) {
+            fclose(data->f);
+        }
+        throw;
+    }
+    // The magic number was already read; stdin can't seek back, so it is
+    // handed to the decompressor as its first input.
+    data->source->unread(magic, n);
+    data->producer = thread(&private_data::produce, data.get());
+}
+
+compressed_input::~compressed_input() {
+    {
+        lock_guard<mutex> lock(data->m);
+        data->stop = true;
+    }
+    data->block_freed.notify_one();
+    data->producer.join();
+    if (data->f != stdin) {
+        fclose(data->f);
+    }
+}
+
+size_t compressed_input::read(char *p, size_t len) {
+    private_data &d = *data;
+    size_t n = 0;
+    while (n < len) {
+        {
+            unique_lock<mutex> lock(d.m);
+            d.block_filled.wait(lock, [&]() { return d.n_filled > 0; });
+        }
+        const block &b = d.ring[d.head];
+        if (d.pos == b.size) {
+            if (b.last) {
+                if (!b.error.empty()) {
+                    throw runtime_error(b.error);
+                }
+                break;
+            }
+            {
+                lock_guard<mutex> lock(d.m);
+                d.head = (d.head + 1) % private_data::n_blocks;
+                --d.n_filled;
+            }
+            d.block_freed.notify_one();
+            d.pos = 0;
+            continue;
+        }
+        size_t k = min(len - n, b.size - d.pos);
+        memcpy(p + n, &b.bytes[d.pos], k);
+        d.pos += k;
+        n += k;
+    }
+    return n;
+}
+
+void compressed_input::read_all(string *out) {
+    size_t len = out->size();
+    for (;;) {
+        out->resize(len + private_data::block_size);
+        size_t n = read(&(*out)[len], private_data::block_size);
+        len += n;
+        if (n == 0) {
+            break;
+        }
+    }
+    out->resize(len);
+}
+
+bool compressed_input::is_compressed(const string &path) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    unsigned char magic[4];
+    size_t n = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+    return detect_compression(magic, n) != compression::none;
+}
+
+void compressed_input::decompress(const char *p, size_t len,
+                                  const string &name, string *out) {
+    unique_ptr<decompressor> source(new_decompressor(
+                detect_compression(reinterpret_cast<const unsigned char *>(p),
+                                   len),
+                0, name));
+    source->set_input(p, len);
+    size_t n = out->size();
+    for (;;) {
+        out->resize(n + private_data::block_size);
+        size_t k = source->fill(&(*out)[n], private_data::block_size);
+        n += k;
+        if (k < private_data::block_size) {
+            break;
+        }
+    }
+    out->resize(n);
+}
+
+bool compressed_input::is_compressed(const char *p, size_t len) {
+    return detect_compression(reinterpret_cast<const unsigned char *>(p),
+                              len) != compression::none;
+}
+
+}
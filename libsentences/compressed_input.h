@@ -0,0 +1,75 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#ifndef LIBSENTENCES__COMPRESSED_INPUT_H
+#define LIBSENTENCES__COMPRESSED_INPUT_H
+
+#include <string>
+#include <memory>
+#include <cstddef>
+
+namespace libsentences {
+
+// Sequential reader of a file that may be compressed with gzip or zstd
+// (recognized by their magic numbers). Decompression runs on a background
+// thread that fills a ring of buffers ahead of the reader, so it overlaps
+// with whatever the reader does with the text.
+class compressed_input {
+    class private_data;
+public:
+    // "-" reads stdin. Throws runtime_error if the file can't be opened or
+    // its compression isn't supported by this build.
+    explicit compressed_input(const std::string &path);
+    compressed_input(const compressed_input &) = delete;
+    compressed_input &operator=(const compressed_input &) = delete;
+    ~compressed_input();
+
+    // Reads up to len bytes, returning 0 at the end. Throws runtime_error
+    // on read or decompression errors.
+    size_t read(char *p, size_t len);
+    // Appends the rest of the input to out.
+    void read_all(std::string *out);
+
+    // Appends the decompressed contents of the file in [p, p + len) to out,
+    // on the calling thread. name is used in error messages.
+    static void decompress(const char *p, size_t len, const std::string &name,
+                           std::string *out);
+
+    // Whether the file starts with a gzip or zstd magic number.
+    static bool is_compressed(const std::string &path);
+    // Same for the first len bytes of a file already in memory.
+    static bool is_compressed(const char *p, size_t len);
+private:
+    std::unique_ptr<private_data> data;
+};
+
+}
+
+#endif
@@ -0,0 +1,241 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#include <libsentences/json_field.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+using namespace std;
+
+namespace libsentences {
+
+static const char *skip_space(const char *p, const char *e) {
+    while (p != e && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        ++p;
+    }
+    return p;
+}
+
+// p points to the opening quote; returns the closing quote.
+static const char *scan_string(const char *p, const char *e) {
+    for (++p; p != e; ++p) {
+        if (*p == '"') {
+            return p;
+        }
+        if (*p == '\\' && ++p == e) {
+            break;
+        }
+    }
+    throw runtime_error("Unterminated JSON string.");
+}
+
+// Returns the end of the value starting at p.
+static const char *skip_value(const char *p, const char *e) {
+    if (p == e) {
+        throw runtime_error("Expected JSON value.");
+    }
+    if (*p == '"') {
+        return scan_string(p, e) + 1;
+    }
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        for (; p != e; ++p) {
+            if (*p == '"') {
+                p = scan_string(p, e);
+            } else if (*p == '{' || *p == '[') {
+                ++depth;
+            } else if ((*p == '}' || *p == ']') && --depth == 0) {
+                return p + 1;
+            }
+        }
+        throw runtime_error("Unterminated JSON object or array.");
+    }
+    const char *start = p;
+    while (p != e && *p != ',' && *p != '}' && *p != ']' && *p != ' ' &&
+           *p != '\t' && *p != '\n' && *p != '\r') {
+        ++p;
+    }
+    if (p == start) {
+        throw runtime_error("Expected JSON value.");
+    }
+    return p;
+}
+
+json_object_scanner::json_object_scanner(const char *p, const char *e,
+                                         const string &key) :
+    v_begin(0), v_end(0), close(0), is_empty(true) {
+    p = skip_space(p, e);
+    if (p == e || *p != '{') {
+        throw runtime_error("Expected JSON object.");
+    }
+    p = skip_space(p + 1, e);
+    if (p != e && *p == '}') {
+        close = p;
+        return;
+    }
+    is_empty = false;
+    for (;;) {
+        if (p == e || *p != '"') {
+            throw runtime_error("Expected JSON member name.");
+        }
+        const char *name_end = scan_string(p, e);
+        bool is_key = size_t(name_end - p - 1) == key.size() &&
+                      memcmp(p + 1, key.data(), key.size()) == 0;
+        p = skip_space(name_end + 1, e);
+        if (p == e || *p != ':') {
+            throw runtime_error("Expected ':' in JSON object.");
+        }
+        p = skip_space(p + 1, e);
+        const char *value_end = skip_value(p, e);
+        if (is_key && *p == '"' && !v_begin) {
+            v_begin = p + 1;
+            v_end = value_end - 1;
+        }
+        p = skip_space(value_end, e);
+        if (p != e && *p == '}') {
+            close = p;
+            return;
+        }
+        if (p == e || *p != ',') {
+            throw runtime_error("Expected ',' or '}' in JSON object.");
+        }
+        p = skip_space(p + 1, e);
+    }
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Reads the four hex digits of a \u escape at p.
+static unsigned read_hex4(const char *p, const char *e) {
+    unsigned x = 0;
+    for (int i = 0; i < 4; ++i) {
+        int d = p + i < e ? hex_digit(p[i]) : -1;
+        if (d < 0) {
+            throw runtime_error("Invalid \\u escape in JSON string.");
+        }
+        x = x << 4 | d;
+    }
+    return x;
+}
+
+static void append_utf8(char32_t c, string *out) {
+    if (c < 0x80) {
+        *out += char(c);
+    } else if (c < 0x800) {
+        *out += char(0xC0 | c >> 6);
+        *out += char(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        *out += char(0xE0 | c >> 12);
+        *out += char(0x80 | (c >> 6 & 0x3F));
+        *out += char(0x80 | (c & 0x3F));
+    } else {
+        *out += char(0xF0 | c >> 18);
+        *out += char(0x80 | (c >> 12 & 0x3F));
+        *out += char(0x80 | (c >> 6 & 0x3F));
+        *out += char(0x80 | (c & 0x3F));
+    }
+}
+
+void json_unescaped_string::assign(const char *begin, const char *end) {
+    unescaped.clear();
+    checkpoints.clear();
+    checkpoints.emplace_back(0, 0);
+    const char *p = begin;
+    while (p != end) {
+        const char *q = static_cast<const char *>(
+                memchr(p, '\\', end - p));
+        if (!q) {
+            q = end;
+        }
+        unescaped.append(p, q);
+        if (q == end) {
+            break;
+        }
+        p = q + 1;
+        if (p == end) {
+            throw runtime_error("Invalid escape in JSON string.");
+        }
+        char c = *p++;
+        switch (c) {
+        case '"': case '\\': case '/':
+            unescaped += c;
+            break;
+        case 'b': unescaped += '\b'; break;
+        case 'f': unescaped += '\f'; break;
+        case 'n': unescaped += '\n'; break;
+        case 'r': unescaped += '\r'; break;
+        case 't': unescaped += '\t'; break;
+        case 'u': {
+            char32_t cp = read_hex4(p, end);
+            p += 4;
+            if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 &&
+                p[0] == '\\' && p[1] == 'u') {
+                unsigned low = read_hex4(p + 2, end);
+                if (low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+            }
+            if (cp >= 0xD800 && cp < 0xE000) {
+                // Unpaired surrogate.
+                cp = 0xFFFD;
+            }
+            append_utf8(cp, &unescaped);
+            break;
+        }
+        default:
+            throw runtime_error("Invalid escape in JSON string.");
+        }
+        checkpoints.emplace_back(unescaped.size(), p - begin);
+    }
+}
+
+size_t json_unescaped_string::escaped_offset(size_t offset) const {
+    // The last checkpoint at or before offset; text after it is copied
+    // unchanged.
+    vector<pair<size_t, size_t>>::const_iterator it = upper_bound(
+            checkpoints.begin(), checkpoints.end(),
+            make_pair(offset, size_t(-1)));
+    --it;
+    return it->second + (offset - it->first);
+}
+
+}
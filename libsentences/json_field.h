@@ -0,0 +1,104 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#ifndef LIBSENTENCES__JSON_FIELD_H
+#define LIBSENTENCES__JSON_FIELD_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+namespace libsentences {
+
+// Finds a string member of a JSON object without parsing the rest of it.
+class json_object_scanner {
+public:
+    // Scans the object in [p, e) for the top level member named key (as it
+    // is spelled in the text, escapes aren't decoded). Throws runtime_error
+    // if the text isn't an object.
+    json_object_scanner(const char *p, const char *e, const std::string &key);
+
+    // Whether the member was found and its value is a string.
+    bool found() const;
+    // Escaped contents of the string value, between the quotes.
+    const char *value_begin() const;
+    const char *value_end() const;
+    // The object's closing brace, and whether it has no members.
+    const char *closing_brace() const;
+    bool empty() const;
+private:
+    const char *v_begin, *v_end;
+    const char *close;
+    bool is_empty;
+};
+
+// Decoded contents of a JSON string, which maps its byte offsets back to
+// offsets in the escaped string.
+class json_unescaped_string {
+public:
+    // Throws runtime_error on invalid escapes.
+    void assign(const char *begin, const char *end);
+
+    const std::string &text() const;
+    size_t escaped_offset(size_t offset) const;
+private:
+    std::string unescaped;
+    // Unescaped and escaped offsets after each escape sequence.
+    std::vector<std::pair<size_t, size_t>> checkpoints;
+};
+
+inline bool json_object_scanner::found() const {
+    return v_begin != 0;
+}
+
+inline const char *json_object_scanner::value_begin() const {
+    return v_begin;
+}
+
+inline const char *json_object_scanner::value_end() const {
+    return v_end;
+}
+
+inline const char *json_object_scanner::closing_brace() const {
+    return close;
+}
+
+inline bool json_object_scanner::empty() const {
+    return is_empty;
+}
+
+inline const std::string &json_unescaped_string::text() const {
+    return unescaped;
+}
+
+}
+
+#endif
@@ -0,0 +1,108 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#include <libsentences/mapped_file.h>
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace libsentences {
+
+mapped_file::mapped_file(const std::string &path) :
+    p(""), len(0), mapped(false) {
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error("Can't open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        throw std::runtime_error("Can't stat " + path);
+    }
+    if (S_ISREG(st.st_mode) && st.st_size == 0) {
+        close(fd);
+        return;
+    }
+    if (S_ISREG(st.st_mode)) {
+        void *m = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            close(fd);
+            p = static_cast<const char *>(m);
+            len = st.st_size;
+            mapped = true;
+            return;
+        }
+    }
+    close(fd);
+#endif
+    std::ifstream ifs(path, std::ios_base::binary);
+    if (!ifs.good()) {
+        throw std::runtime_error("Can't open " + path);
+    }
+    buffer.assign(std::istreambuf_iterator<char>(ifs),
+                  std::istreambuf_iterator<char>());
+    p = buffer.data();
+    len = buffer.size();
+}
+
+mapped_file::~mapped_file() {
+#ifndef _WIN32
+    if (mapped) {
+        munmap(const_cast<char *>(p), len);
+    }
+#endif
+}
+
+void mapped_file::advise_sequential() const {
+#if !defined(_WIN32) && defined(MADV_SEQUENTIAL)
+    if (mapped) {
+        madvise(const_cast<char *>(p), len, MADV_SEQUENTIAL);
+    }
+#endif
+}
+
+void mapped_file::prefetch() const {
+#if !defined(_WIN32) && defined(MADV_WILLNEED)
+    if (mapped) {
+        madvise(const_cast<char *>(p), len, MADV_WILLNEED);
+    }
+#endif
+}
+
+}
@@ -31,54 +31,202 @@ either expressed or implied, of Frane Saric.
 #include "libsentences/memory_pool.h"
 
 #include <cstdlib>
-#include <list>
+#include <new>
 #include <stdexcept>
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 namespace libsentences {
 
-memory_pool::~memory_pool() {
-    for (std::list<void *>::iterator i = blocks.begin(), j = blocks.end();
-         i != j; ++i) {
-        free(*i);
+struct memory_pool::block_header {
+    block_header *next;
+    // Usable bytes after the header.
+    size_t size;
+    // Bytes of the block handed out, once it isn't the one being filled.
+    size_t used;
+    // Mapped with mmap instead of malloc; size + sizeof(block_header) bytes.
+    bool mapped;
+
+    char *data() {
+        return reinterpret_cast<char *>(this + 1);
+    }
+    const char *data() const {
+        return reinterpret_cast<const char *>(this + 1);
     }
+};
+
+static const size_t huge_page_size = 2 * 1024 * 1024;
+
+memory_pool::~memory_pool() {
+    free_chain(used_blocks);
+    free_chain(free_blocks);
 }
 
 memory_pool &memory_pool::operator=(memory_pool &&b) {
-    for (std::list<void *>::iterator i = blocks.begin(), j = blocks.end();
-         i != j; ++i) {
-        free(*i);
-    }
+    free_chain(used_blocks);
+    free_chain(free_blocks);
 
     block_start = b.block_start;
     block_end = b.block_end;
+    used_blocks = b.used_blocks;
+    free_blocks = b.free_blocks;
     block_size = b.block_size;
+    max_block_size = b.max_block_size;
+    huge_pages = b.huge_pages;
+    n_system_allocations = b.n_system_allocations;
+    n_resets = b.n_resets;
     b.block_start = 0;
     b.block_end = 0;
+    b.used_blocks = 0;
+    b.free_blocks = 0;
     b.block_size = 0;
-    blocks = move(b.blocks);
 
     return *this;
 }
 
+void memory_pool::free_chain(block_header *block) {
+    while (block) {
+        block_header *next = block->next;
+#ifdef __linux__
+        if (block->mapped) {
+            munmap(block, block->size + sizeof(block_header));
+            block = next;
+            continue;
+        }
+#endif
+        free(block);
+        block = next;
+    }
+}
+
+memory_pool::block_header *memory_pool::new_block(size_t size) {
+    block_header *block = 0;
+    bool mapped = false;
+#ifdef __linux__
+    if (huge_pages && size >= huge_page_size) {
+        size_t total = (size + sizeof(block_header) + huge_page_size - 1) &
+            ~(huge_page_size - 1);
+        // Map an extra huge page and unmap the ends, so the block is
+        // aligned to huge pages.
+        void *p = mmap(0, total + huge_page_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            char *first = static_cast<char *>(p);
+            char *aligned = first + ((-reinterpret_cast<uintptr_t>(first)) &
+                                     (huge_page_size - 1));
+            if (aligned != first) {
+                munmap(first, aligned - first);
+            }
+            munmap(aligned + total, first + huge_page_size - aligned);
+#ifdef MADV_HUGEPAGE
+            madvise(aligned, total, MADV_HUGEPAGE);
+#endif
+            block = reinterpret_cast<block_header *>(aligned);
+            size = total - sizeof(block_header);
+            mapped = true;
+        }
+    }
+#endif
+    if (!block) {
+        block = static_cast<block_header *>(
+                malloc(size + sizeof(block_header)));
+        if (!block) {
+            throw std::bad_alloc();
+        }
+    }
+    block->next = 0;
+    block->size = size;
+    block->used = 0;
+    block->mapped = mapped;
+    ++n_system_allocations;
+    return block;
+}
+
 void *memory_pool::slow_alloc(size_t buffer_size, unsigned alignment) {
     if (!block_size) {
         throw std::runtime_error("Using uninitiallized memory pool.");
     }
-    if (buffer_size > block_size) {
-        void *block = malloc(buffer_size + alignment - 1);
-        blocks.push_back(block);
-        void *aligned_start = static_cast<char *>(block) +
-            ((-reinterpret_cast<uintptr_t>(block)) & (alignment - 1));
+    size_t needed = buffer_size + alignment - 1;
+    // Reuse a block kept by reset if one is big enough.
+    block_header *block = 0;
+    for (block_header **p = &free_blocks; *p; p = &(*p)->next) {
+        if ((*p)->size >= needed) {
+            block = *p;
+            *p = block->next;
+            break;
+        }
+    }
+    bool oversized = false;
+    if (!block) {
+        // Block sizes include the header, so they stay multiples of pages.
+        size_t capacity = block_size > sizeof(block_header) ?
+            block_size - sizeof(block_header) : 0;
+        oversized = needed > capacity;
+        block = new_block(oversized ? needed : capacity);
+        if (!oversized) {
+            block_size = block_size * 2 > max_block_size ? max_block_size
+                                                         : block_size * 2;
+        }
+    }
+    char *aligned_start = block->data() +
+        ((-reinterpret_cast<uintptr_t>(block->data())) & (alignment - 1));
+    if (oversized && used_blocks) {
+        // Keep filling the current block.
+        block->used = block->size;
+        block->next = used_blocks->next;
+        used_blocks->next = block;
         return aligned_start;
     }
-    size_t effective_block_size = block_size + alignment - 1;
-    void *block = malloc(effective_block_size);
-    blocks.push_back(block);
-    void *aligned_start = static_cast<char *>(block) +
-        ((-reinterpret_cast<uintptr_t>(block)) & (alignment - 1));
-    block_start = static_cast<char *>(aligned_start) + buffer_size;
-    block_end = static_cast<char *>(block) + effective_block_size;
+    if (used_blocks) {
+        used_blocks->used = static_cast<char *>(block_start) -
+            used_blocks->data();
+    }
+    block->next = used_blocks;
+    used_blocks = block;
+    block_start = aligned_start + buffer_size;
+    block_end = block->data() + block->size;
     return aligned_start;
 }
 
+void memory_pool::reset() {
+    while (used_blocks) {
+        block_header *next = used_blocks->next;
+        used_blocks->used = 0;
+        used_blocks->next = free_blocks;
+        free_blocks = used_blocks;
+        used_blocks = next;
+    }
+    block_start = 0;
+    block_end = 0;
+    ++n_resets;
+}
+
+void memory_pool::release_free_blocks() {
+    free_chain(free_blocks);
+    free_blocks = 0;
+}
+
+memory_pool_stats memory_pool::stats() const {
+    memory_pool_stats s;
+    s.n_blocks = 0;
+    s.bytes_reserved = 0;
+    s.bytes_used = 0;
+    for (const block_header *b = used_blocks; b; b = b->next) {
+        ++s.n_blocks;
+        s.bytes_reserved += b->size;
+        s.bytes_used += b == used_blocks ?
+            static_cast<const char *>(block_start) - b->data() :
+            b->used;
+    }
+    for (const block_header *b = free_blocks; b; b = b->next) {
+        ++s.n_blocks;
+        s.bytes_reserved += b->size;
+    }
+    s.n_system_allocations = n_system_allocations;
+    s.n_resets = n_resets;
+    return s;
+}
+
 }
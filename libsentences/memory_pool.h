@@ -31,15 +31,35 @@ either expressed or implied, of Frane Saric.
 #ifndef LIBSENTENCES__MEMORY_POOL_H
 #define LIBSENTENCES__MEMORY_POOL_H
 
-#include <list>
 #include <cstddef>
 #include <cstdint>
 
 namespace libsentences {
 
+struct memory_pool_stats {
+    // Blocks held by the pool, in use or kept for reuse after reset.
+    size_t n_blocks;
+    size_t bytes_reserved;
+    // Bytes handed out since the last reset, including alignment padding
+    // and the unused ends of filled blocks.
+    size_t bytes_used;
+    // Blocks ever obtained from malloc or mmap. It stops growing once the
+    // pool is reused after reset for allocations of the same size.
+    size_t n_system_allocations;
+    size_t n_resets;
+};
+
+// Arena allocator. Allocations are only freed all at once, by reset (which
+// keeps the blocks for reuse) or by the destructor.
 class memory_pool {
 public:
-    explicit memory_pool(size_t block_size = 32 * 1024);
+    // Each new block is twice as big as the previous one, up to
+    // max_block_size (no growth if it is smaller than block_size). With
+    // huge_pages, blocks of at least 2 MB are mapped with transparent huge
+    // pages where available.
+    explicit memory_pool(size_t block_size = 32 * 1024,
+                         size_t max_block_size = 0,
+                         bool huge_pages = false);
     memory_pool(const memory_pool &) = delete;
     memory_pool(memory_pool &&);
 
@@ -50,24 +70,51 @@ public:
 
     void *allocate(size_t buffer_size);
     void *allocate(size_t buffer_size, unsigned alignment);
+
+    // Invalidates all allocations, keeping the blocks for reuse.
+    void reset();
+    // Frees the blocks kept by reset that aren't in use again.
+    void release_free_blocks();
+
+    memory_pool_stats stats() const;
 private:
+    struct block_header;
+
     void *slow_alloc(size_t buffer_size, unsigned alignment);
+    block_header *new_block(size_t size);
+    void free_chain(block_header *block);
 
     void *block_start;
     void *block_end;
-    std::list<void *> blocks;
+    // The first used block is the one being filled.
+    block_header *used_blocks;
+    block_header *free_blocks;
     size_t block_size;
+    size_t max_block_size;
+    bool huge_pages;
+    size_t n_system_allocations;
+    size_t n_resets;
 };
 
-inline memory_pool::memory_pool(size_t block_size_) :
-    block_start(0), block_end(0), block_size(block_size_) {
+inline memory_pool::memory_pool(size_t block_size_, size_t max_block_size_,
+                                bool huge_pages_) :
+    block_start(0), block_end(0), used_blocks(0), free_blocks(0),
+    block_size(block_size_),
+    max_block_size(max_block_size_ < block_size_ ? block_size_
+                                                 : max_block_size_),
+    huge_pages(huge_pages_), n_system_allocations(0), n_resets(0) {
 }
 
 inline memory_pool::memory_pool(memory_pool &&b) :
     block_start(b.block_start), block_end(b.block_end),
-    blocks(move(b.blocks)), block_size(std::move(b.block_size)) {
+    used_blocks(b.used_blocks), free_blocks(b.free_blocks),
+    block_size(b.block_size), max_block_size(b.max_block_size),
+    huge_pages(b.huge_pages), n_system_allocations(b.n_system_allocations),
+    n_resets(b.n_resets) {
     b.block_start = 0;
     b.block_end = 0;
+    b.used_blocks = 0;
+    b.free_blocks = 0;
     b.block_size = 0;
 }
 
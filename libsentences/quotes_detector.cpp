@@ -33,6 +33,7 @@ either expressed or implied, of Frane Saric.
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
 
 using namespace std;
 
@@ -67,6 +68,14 @@ const quotes_detector::quote_pair_spec *quotes_detector::find_spec(
     return 0;
 }
 
+int quotes_detector::max_token_dist() const {
+    int rez = 0;
+    for (unsigned i = 0; i < specs.size(); ++i) {
+        rez = max(rez, specs[i].max_token_dist);
+    }
+    return rez;
+}
+
 void quotes_detector::add_specs(const std::string &specs_string) {
     vector<string> specs;
     boost::split(specs, specs_string, boost::is_any_of(","));
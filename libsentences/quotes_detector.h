@@ -50,6 +50,8 @@ public:
     void add_spec(const quote_pair_spec &qps);
     void add_specs(const std::string &specs);
     const quote_pair_spec *find_spec(const utf8_slice &token) const;
+    // Largest max_token_dist of all specs, 0 without specs.
+    int max_token_dist() const;
 private:
     std::vector<quote_pair_spec> specs;
     std::vector<char> is_open_candidate;
@@ -29,10 +29,15 @@ either expressed or implied, of Frane Saric.
 */
 
 #include <libsentences/sbd_model.h>
+#include <libsentences/sbd_model_inspector.h>
 #include <libsentences/sbd_context.h>
 
 #include <libsentences/standard_tokenizer.h>
 #include <libsentences/memory_pool.h>
+#include <libsentences/mapped_file.h>
+#include <libsentences/compressed_input.h>
+#include <libsentences/splitter_stats.h>
+#include <libsentences/tracepoints.h>
 
 #include <algorithm>
 #include <numeric>
@@ -40,7 +45,14 @@ either expressed or implied, of Frane Saric.
 #include <unordered_set>
 #include <cmath>
 #include <cstdlib>
+#include <cstdint>
+#include <cstring>
 #include <array>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <random>
 
 #include <sstream>
 #include <fstream>
@@ -50,10 +62,11 @@ using namespace std;
 
 namespace libsentences {
 
+// One vocabulary token or hash bucket. The token strings are kept apart in
+// sbd_model_params::tokens, so hash buckets don't pay for them.
 struct token_data {
     array<double, sbd_context::context_size> features;
     unsigned classes_mask;
-    utf8_slice token;
 
     token_data() : classes_mask(0) {
         features.fill(0.);
@@ -181,13 +194,20 @@ public:
     static const int n_global_features =
         ContextGenerator::n_global_features;
 
-    sbd_model_params() : bias(0.) {
+    sbd_model_params() : bias(0.), token_pool(32 * 1024, 1024 * 1024),
+                         hash_bits(0) {
         global_features.fill(0.);
     }
 
     bool is_eos(const sbd_context &context) const;
+    // Positive for sentence endings.
+    double margin(const sbd_context &context,
+                  splitter_stats *stats = 0) const;
     bool is_eos_candidate(const utf8_slice &token) const;
     int get_or_add_feature(const utf8_slice &feature);
+    int find_feature(const utf8_slice &feature) const;
+    void set_hash_bits(unsigned hash_bits);
+    unsigned get_hash_bits() const;
     void set_eos_chars(const vector<char32_t> &eos_chars);
     const vector<char32_t> &get_eos_chars() const;
 
@@ -203,9 +223,16 @@ public:
     word_class_features_type word_class_features;
     typedef vector<token_data> token_features_type;
     token_features_type token_features;
+    // The token of each of token_features; empty when hashing.
+    vector<utf8_slice> tokens;
 private:
+    unsigned hashed_feature(const utf8_slice &feature) const;
+
     vector<char32_t> eos_chars;
     vector<char> eos_char_filter;
+    // When nonzero, tokens are hashed into 2^hash_bits token_features
+    // buckets and token_to_idx isn't used.
+    unsigned hash_bits;
 };
 
 template<class ContextGenerator>
@@ -240,9 +267,52 @@ bool sbd_model_params<ContextGenerator>::is_eos_candidate(
     return false;
 }
 
+template<class ContextGenerator>
+void sbd_model_params<ContextGenerator>::set_hash_bits(unsigned hash_bits_) {
+    hash_bits = hash_bits_;
+    token_to_idx.clear();
+    token_features.clear();
+    tokens.clear();
+    if (hash_bits) {
+        token_features.resize(1 << hash_bits);
+    }
+}
+
+template<class ContextGenerator>
+unsigned sbd_model_params<ContextGenerator>::get_hash_bits() const {
+    return hash_bits;
+}
+
+template<class ContextGenerator>
+unsigned sbd_model_params<ContextGenerator>::hashed_feature(
+        const utf8_slice &feature) const {
+    // utf8_slice::hash doesn't mix its low bits well enough to be masked
+    // directly, so apply a murmur3 finalizer.
+    uint32_t h = utf8_slice::hash()(feature);
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h & ((1 << hash_bits) - 1);
+}
+
+template<class ContextGenerator>
+int sbd_model_params<ContextGenerator>::find_feature(
+        const utf8_slice &feature) const {
+    if (hash_bits) {
+        return hashed_feature(feature);
+    }
+    auto f_it = token_to_idx.find(feature);
+    return f_it != token_to_idx.end() ? f_it->second : -1;
+}
+
 template<class ContextGenerator>
 int sbd_model_params<ContextGenerator>::get_or_add_feature(
         const utf8_slice &feature) {
+    if (hash_bits) {
+        return hashed_feature(feature);
+    }
     auto f_it = token_to_idx.find(feature);
     if (f_it != token_to_idx.end()) {
         return f_it->second;
@@ -253,7 +323,7 @@ int sbd_model_params<ContextGenerator>::get_or_add_feature(
     utf8_slice new_token = utf8_slice(str, feature.size());
     token_to_idx.insert(make_pair(new_token, feature_idx));
     token_features.emplace_back();
-    token_features.back().token = new_token;
+    tokens.push_back(new_token);
     return feature_idx;
 }
 
@@ -328,12 +398,23 @@ private:
 template<class ContextGenerator>
 bool sbd_model_params<ContextGenerator>::is_eos(
         const sbd_context &context) const {
+    return margin(context) > 0;
+}
+
+template<class ContextGenerator>
+double sbd_model_params<ContextGenerator>::margin(
+        const sbd_context &context, splitter_stats *stats) const {
+    (void)stats; // Only used with LIBSENTENCES_STATS.
     double w = 0;
     int token_idx[sbd_context::context_size];
     for (int k = 0; k < sbd_context::context_size; ++k) {
-        auto i = token_to_idx.find(
-                context.get_token(k - sbd_context::context_left));
-        token_idx[k] = i != token_to_idx.end() ? i->second : -1;
+        const utf8_slice &token =
+            context.get_token(k - sbd_context::context_left);
+        token_idx[k] = find_feature(token);
+        LIBSENTENCES_STAT_ADD(stats, vocabulary_hits,
+                              !token.empty() && token_idx[k] != -1);
+        LIBSENTENCES_STAT_ADD(stats, vocabulary_misses,
+                              !token.empty() && token_idx[k] == -1);
     }
     context_generator::get_context(context,
             lookup_context_token_features<token_features_type>
@@ -344,8 +425,7 @@ bool sbd_model_params<ContextGenerator>::is_eos(
                                                word_class_features_type>
                 (w, token_idx, token_features, word_class_features)
             );
-    w += bias;
-    return w > 0;
+    return w + bias;
 }
 
 static vector<char32_t> collect_eos_chars(const vector<string> &lines,
@@ -385,9 +465,21 @@ sbd_model::sbd_model() : data(new private_data) {
 }
 
 bool sbd_model::is_eos(const sbd_context &context) const {
+    return is_eos(context, 0);
+}
+
+bool sbd_model::is_eos(const sbd_context &context,
+                       splitter_stats *stats) const {
     const model_params &params = data->params;
-    return params.is_eos_candidate(context.get_token(0)) &&
-           params.is_eos(context);
+    LIBSENTENCES_STAT_ADD(stats, eos_candidate_checks, 1);
+    if (!params.is_eos_candidate(context.get_token(0))) {
+        return false;
+    }
+    LIBSENTENCES_STAT_ADD(stats, model_evaluations, 1);
+    double margin = params.margin(context, stats);
+    LIBSENTENCES_TRACE3(eos__decision, context.get_token(0).end().ptr(),
+                        int64_t(margin * 1e6), margin > 0);
+    return margin > 0;
 }
 
 static void load_word_classes(model_params &params,
@@ -437,21 +529,95 @@ static void load_word_classes(model_params &params,
 
 typedef vector<pair<unsigned, double>> sample_type;
 
+static unsigned token_features_offset(const model_params &params) {
+    return 1 + params.global_features.size() +
+           params.word_class_features.size() * sbd_context::context_size;
+}
+
+// Count-min sketch of (token, context position) frequencies. Estimates are
+// never below the true count, so a token whose estimate is below the
+// feature frequency threshold can safely be left out of the vocabulary.
+// add can be called from many threads at once.
+class feature_count_sketch {
+public:
+    static const int depth = 4;
+
+    explicit feature_count_sketch(unsigned width_bits);
+
+    void add(const utf8_slice &token, int position);
+    unsigned estimate(const utf8_slice &token, int position) const;
+private:
+    unsigned bucket(uint32_t token_hash, int row) const;
+
+    unsigned width_bits;
+    vector<atomic<uint32_t>> counts;
+};
+
+feature_count_sketch::feature_count_sketch(unsigned width_bits_) :
+    width_bits(width_bits_), counts(depth << width_bits) {
+}
+
+inline unsigned feature_count_sketch::bucket(uint32_t h, int row) const {
+    h += row * 0x9e3779b9;
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return (row << width_bits) + (h & ((1 << width_bits) - 1));
+}
+
+void feature_count_sketch::add(const utf8_slice &token, int position) {
+    uint32_t h = utf8_slice::hash()(token) * sbd_context::context_size +
+                 position;
+    for (int row = 0; row < depth; ++row) {
+        atomic<uint32_t> &count = counts[bucket(h, row)];
+        uint32_t c = count.load(memory_order_relaxed);
+        while (c != UINT32_MAX &&
+               !count.compare_exchange_weak(c, c + 1,
+                                            memory_order_relaxed)) {
+        }
+    }
+}
+
+unsigned feature_count_sketch::estimate(const utf8_slice &token,
+                                        int position) const {
+    uint32_t h = utf8_slice::hash()(token) * sbd_context::context_size +
+                 position;
+    uint32_t rez = UINT32_MAX;
+    for (int row = 0; row < depth; ++row) {
+        rez = min(rez, counts[bucket(h, row)].load(memory_order_relaxed));
+    }
+    return rez;
+}
+
+template<class Vocabulary>
 class word_features_to_sample {
 public:
     word_features_to_sample(
             const sbd_context &context_,
             sample_type &current_sample_,
-            model_params &params_) :
+            const model_params &params_,
+            Vocabulary &vocabulary_,
+            const feature_count_sketch *sketch_,
+            unsigned min_frequency_) :
         context(context_),
         current_sample(current_sample_),
-        params(params_) {
+        offset(token_features_offset(params_)),
+        vocabulary(vocabulary_),
+        sketch(sketch_),
+        min_frequency(min_frequency_) {
     }
     void operator()(int idx) const {
-        int offset = 1 + params.global_features.size() +
-                     params.word_class_features.size() *
-                     sbd_context::context_size;
-        int w_idx = params.get_or_add_feature(context.get_token(idx));
+        if (sketch && sketch->estimate(context.get_token(idx), idx) <
+                      min_frequency) {
+            // Would be removed by remove_low_frequency_features anyway.
+            return;
+        }
+        int w_idx = vocabulary.get_or_add_feature(context.get_token(idx));
+        if (w_idx == -1) {
+            return;
+        }
         current_sample.emplace_back(
                 offset + w_idx * sbd_context::context_size +
                 (idx + sbd_context::context_left), 1.);
@@ -459,7 +625,10 @@ public:
 private:
     const sbd_context &context;
     sample_type &current_sample;
-    model_params &params;
+    unsigned offset;
+    Vocabulary &vocabulary;
+    const feature_count_sketch *sketch;
+    unsigned min_frequency;
 };
 
 class global_features_to_sample {
@@ -489,11 +658,10 @@ public:
         if (params.word_class_features.empty()) {
             return;
         }
-        auto i = params.token_to_idx.find(context.get_token(idx));
-        if (i != params.token_to_idx.end()) {
+        int i = params.find_feature(context.get_token(idx));
+        if (i != -1) {
             int offset = 1 + params.global_features.size();
-            unsigned mask =
-                params.token_features[i->second].classes_mask;
+            unsigned mask = params.token_features[i].classes_mask;
             for (int bit = 0; mask; ++bit) {
                 if (mask & (1 << bit)) {
                     mask &= ~(1 << bit);
@@ -511,32 +679,173 @@ private:
     const model_params &params;
 };
 
-static void generate_features(
-        model_params &params,
-        const string &train_path,
-        vector<sample_type> *samples,
-        vector<double> *labels) {
-    vector<string> lines;
-    {
-        ifstream ifs(train_path);
-        if (!ifs.good()) {
-            throw runtime_error ("Can't train file.");
+// Vocabulary of a trained model, which only looks tokens up.
+class lookup_vocabulary {
+public:
+    explicit lookup_vocabulary(const model_params &params_) :
+        params(params_) {
+    }
+    int get_or_add_feature(const utf8_slice &feature) const {
+        return params.find_feature(feature);
+    }
+private:
+    const model_params &params;
+};
+
+// Token vocabulary of a single training shard. Tokens point into the
+// training lines, which outlive the shard, so nothing is copied.
+class shard_vocabulary {
+public:
+    int get_or_add_feature(const utf8_slice &feature);
+
+    vector<utf8_slice> tokens;
+private:
+    unordered_map<utf8_slice, int, utf8_slice::hash, utf8_slice::equal>
+        token_to_idx;
+};
+
+int shard_vocabulary::get_or_add_feature(const utf8_slice &feature) {
+    auto f_it = token_to_idx.find(feature);
+    if (f_it != token_to_idx.end()) {
+        return f_it->second;
+    }
+    int feature_idx = tokens.size();
+    token_to_idx.insert(make_pair(feature, feature_idx));
+    tokens.push_back(feature);
+    return feature_idx;
+}
+
+// Collects samples, collapsing identical (sample, label) pairs into a single
+// sample with a count when deduplication is enabled. The first occurrence
+// determines the position of a sample.
+class sample_collector {
+public:
+    sample_collector(vector<sample_type> *samples, vector<double> *labels,
+                     vector<int> *counts, bool deduplicate);
+
+    void add(sample_type &&sample, double label, int count);
+private:
+    class index_hash {
+    public:
+        explicit index_hash(const sample_collector &c_) : c(c_) {
         }
-        for (string line; getline(ifs, line); ) {
-            lines.push_back(line);
+        size_t operator()(unsigned idx) const;
+    private:
+        const sample_collector &c;
+    };
+    class index_equal {
+    public:
+        explicit index_equal(const sample_collector &c_) : c(c_) {
         }
+        bool operator()(unsigned a, unsigned b) const;
+    private:
+        const sample_collector &c;
+    };
+
+    vector<sample_type> *samples;
+    vector<double> *labels;
+    vector<int> *counts;
+    bool deduplicate;
+    unordered_set<unsigned, index_hash, index_equal> index;
+};
 
-        params.set_eos_chars(collect_eos_chars(lines, 2));
+sample_collector::sample_collector(vector<sample_type> *samples_,
+                                   vector<double> *labels_,
+                                   vector<int> *counts_,
+                                   bool deduplicate_) :
+    samples(samples_), labels(labels_), counts(counts_),
+    deduplicate(deduplicate_),
+    index(0, index_hash(*this), index_equal(*this)) {
+    for (unsigned i = 0; deduplicate && i < samples->size(); ++i) {
+        index.insert(i);
     }
-    sbd_context context;
-    sample_type current_sample;
-    word_features_to_sample wfs(context, current_sample, params);
-    global_features_to_sample gfs(current_sample);
-    word_class_features_to_sample wcfs(context, current_sample, params);
+}
 
-    context = sbd_context();
-    bool was_eos = false;
-    for (unsigned line_idx = 0; line_idx < lines.size(); ++line_idx) {
+size_t sample_collector::index_hash::operator()(unsigned idx) const {
+    const sample_type &sample = (*c.samples)[idx];
+    size_t hash = (*c.labels)[idx] > 0;
+    for (unsigned i = 0; i < sample.size(); ++i) {
+        hash ^= sample[i].first + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
+bool sample_collector::index_equal::operator()(unsigned a,
+                                               unsigned b) const {
+    return (*c.labels)[a] == (*c.labels)[b] &&
+           (*c.samples)[a] == (*c.samples)[b];
+}
+
+void sample_collector::add(sample_type &&sample, double label, int count) {
+    samples->push_back(move(sample));
+    labels->push_back(label);
+    counts->push_back(count);
+    if (!deduplicate) {
+        return;
+    }
+    auto rez = index.insert(samples->size() - 1);
+    if (!rez.second) {
+        (*counts)[*rez.first] += count;
+        samples->pop_back();
+        labels->pop_back();
+        counts->pop_back();
+    }
+}
+
+static void deduplicate_samples(vector<sample_type> &samples,
+                                vector<double> &labels,
+                                vector<int> &counts) {
+    vector<sample_type> old_samples;
+    vector<double> old_labels;
+    vector<int> old_counts;
+    old_samples.swap(samples);
+    old_labels.swap(labels);
+    old_counts.swap(counts);
+    sample_collector collector(&samples, &labels, &counts, true);
+    for (unsigned i = 0; i < old_samples.size(); ++i) {
+        collector.add(move(old_samples[i]), old_labels[i], old_counts[i]);
+    }
+}
+
+struct training_shard {
+    unsigned first_line;
+    unsigned last_line;
+    shard_vocabulary vocabulary;
+    vector<sample_type> samples;
+    vector<double> labels;
+    vector<int> counts;
+};
+
+// Fills the context with the tokens preceding first_line, so that a shard
+// starts in exactly the same state as the sequential pass would.
+static void prime_context(const vector<string> &lines, unsigned first_line,
+                          sbd_context &context) {
+    const int n_needed = sbd_context::context_size - 1;
+    vector<utf8_slice> preceding;
+    for (unsigned line_idx = first_line; line_idx > 0 &&
+         static_cast<int>(preceding.size()) < n_needed; --line_idx) {
+        auto tokens = standard_tokenizer(lines[line_idx - 1]);
+        vector<utf8_slice> line_tokens(tokens.begin(), tokens.end());
+        preceding.insert(preceding.begin(), line_tokens.begin(),
+                         line_tokens.end());
+    }
+    int skip = max(0, static_cast<int>(preceding.size()) - n_needed);
+    for (unsigned i = skip; i < preceding.size(); ++i) {
+        context.add_token(preceding[i]);
+    }
+}
+
+// Calls func(context, label) for every eos candidate in the given lines.
+template<class F>
+static void for_each_candidate(const model_params &params,
+                               const vector<string> &lines,
+                               unsigned first_line,
+                               unsigned last_line,
+                               F func) {
+    sbd_context context;
+    prime_context(lines, first_line, context);
+    bool was_eos = first_line > 0;
+    for (unsigned line_idx = first_line; line_idx < last_line; ++line_idx) {
         const string &line = lines[line_idx];
         auto tokens = standard_tokenizer(line);
         for (auto tcur = tokens.begin(), tend = tokens.end();
@@ -545,20 +854,293 @@ static void generate_features(
             const utf8_slice &center_word = context.get_token(0);
             if (!center_word.empty() &&
                 params.is_eos_candidate(center_word)) {
-                double label = was_eos ? 1. : -1.;
-
-                current_sample.clear();
-                current_sample.emplace_back(0, 1.); // bias
-                model_params::context_generator::get_context(
-                        context, wfs, gfs, wcfs);
-                sort(current_sample.begin(), current_sample.end());
-                labels->push_back(label);
-                samples->push_back(move(current_sample));
+                func(context, was_eos ? 1. : -1.);
             }
             was_eos = false;
         }
         was_eos = true;
     }
+}
+
+template<class Vocabulary>
+static void extract_samples(
+        const model_params &params,
+        Vocabulary &vocabulary,
+        const vector<string> &lines,
+        unsigned first_line,
+        unsigned last_line,
+        const sbd_train_options &options,
+        const feature_count_sketch *sketch,
+        vector<sample_type> *samples,
+        vector<double> *labels,
+        vector<int> *counts) {
+    sample_collector collector(samples, labels, counts,
+                               options.deduplicate_samples);
+    sample_type current_sample;
+    for_each_candidate(params, lines, first_line, last_line,
+                       [&](const sbd_context &context, double label) {
+        word_features_to_sample<Vocabulary> wfs(
+                context, current_sample, params, vocabulary, sketch,
+                options.min_feature_frequency);
+        global_features_to_sample gfs(current_sample);
+        word_class_features_to_sample wcfs(context, current_sample, params);
+
+        current_sample.clear();
+        current_sample.emplace_back(0, 1.); // bias
+        model_params::context_generator::get_context(
+                context, wfs, gfs, wcfs);
+        sort(current_sample.begin(), current_sample.end());
+        collector.add(move(current_sample), label, 1);
+    });
+}
+
+static void get_context_features(const model_params &params,
+                                 const sbd_context &context,
+                                 sample_type &sample) {
+    lookup_vocabulary vocabulary(params);
+    word_features_to_sample<lookup_vocabulary> wfs(
+            context, sample, params, vocabulary, 0, 0);
+    global_features_to_sample gfs(sample);
+    word_class_features_to_sample wcfs(context, sample, params);
+
+    sample.clear();
+    sample.emplace_back(0, 1.); // bias
+    model_params::context_generator::get_context(context, wfs, gfs, wcfs);
+    sort(sample.begin(), sample.end());
+}
+
+void sbd_model_inspector::get_features(const sbd_model &model,
+        const sbd_context &context,
+        vector<pair<unsigned, double>> *features) {
+    get_context_features(model.data->params, context, *features);
+}
+
+// Maps shard-local token feature indices to the global feature space.
+static void remap_shard_samples(const model_params &params,
+                                const vector<int> &global_idx,
+                                vector<sample_type> &samples) {
+    unsigned offset = token_features_offset(params);
+    for (unsigned sample_idx = 0; sample_idx < samples.size();
+         ++sample_idx) {
+        sample_type &sample = samples[sample_idx];
+        for (unsigned i = 0; i < sample.size(); ++i) {
+            unsigned idx = sample[i].first;
+            if (idx >= offset) {
+                idx -= offset;
+                sample[i].first = offset +
+                    global_idx[idx / sbd_context::context_size] *
+                    sbd_context::context_size +
+                    idx % sbd_context::context_size;
+            }
+        }
+        sort(sample.begin(), sample.end());
+    }
+}
+
+template<class F>
+static void run_parallel(int n_threads, F func) {
+    vector<thread> threads;
+    for (int i = 1; i < n_threads; ++i) {
+        threads.emplace_back(func, i);
+    }
+    func(0);
+    for (unsigned i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+}
+
+// Splits lines [first_line, last_line) into n_shards ranges with roughly
+// equal byte counts.
+static vector<pair<unsigned, unsigned>> split_lines(
+        const vector<string> &lines, unsigned first_line, unsigned last_line,
+        int n_shards) {
+    vector<pair<unsigned, unsigned>> ranges(n_shards);
+    size_t total_size = 0;
+    for (unsigned i = first_line; i < last_line; ++i) {
+        total_size += lines[i].size() + 1;
+    }
+    size_t cur_size = 0;
+    unsigned line_idx = first_line;
+    for (int shard_idx = 0; shard_idx < n_shards; ++shard_idx) {
+        ranges[shard_idx].first = line_idx;
+        size_t shard_end = total_size * (shard_idx + 1) / n_shards;
+        while (line_idx < last_line && cur_size < shard_end) {
+            cur_size += lines[line_idx++].size() + 1;
+        }
+        ranges[shard_idx].second = line_idx;
+    }
+    ranges.back().second = last_line;
+    return ranges;
+}
+
+// Extracts each range of lines on its own thread. If shard_starts isn't
+// null, it receives the index of the first sample of every range.
+static void generate_features_parallel(
+        model_params &params,
+        const vector<string> &lines,
+        const vector<pair<unsigned, unsigned>> &ranges,
+        const sbd_train_options &options,
+        const feature_count_sketch *sketch,
+        vector<sample_type> *samples,
+        vector<double> *labels,
+        vector<int> *counts,
+        vector<unsigned> *shard_starts = 0) {
+    int n_threads = ranges.size();
+    vector<training_shard> shards(n_threads);
+    for (int shard_idx = 0; shard_idx < n_threads; ++shard_idx) {
+        shards[shard_idx].first_line = ranges[shard_idx].first;
+        shards[shard_idx].last_line = ranges[shard_idx].second;
+    }
+
+    run_parallel(n_threads, [&](int shard_idx) {
+        training_shard &shard = shards[shard_idx];
+        extract_samples(params, shard.vocabulary, lines, shard.first_line,
+                        shard.last_line, options, sketch, &shard.samples,
+                        &shard.labels, &shard.counts);
+    });
+
+    // Adding shard vocabularies in corpus order yields the same feature
+    // indices as a sequential pass.
+    vector<vector<int>> global_idx(n_threads);
+    for (int shard_idx = 0; shard_idx < n_threads; ++shard_idx) {
+        const vector<utf8_slice> &tokens = shards[shard_idx].vocabulary.tokens;
+        for (unsigned i = 0; i < tokens.size(); ++i) {
+            global_idx[shard_idx].push_back(
+                    params.get_or_add_feature(tokens[i]));
+        }
+    }
+
+    run_parallel(n_threads, [&](int shard_idx) {
+        remap_shard_samples(params, global_idx[shard_idx],
+                            shards[shard_idx].samples);
+    });
+
+    for (int shard_idx = 0; shard_idx < n_threads; ++shard_idx) {
+        training_shard &shard = shards[shard_idx];
+        if (shard_starts) {
+            shard_starts->push_back(samples->size());
+        }
+        move(shard.samples.begin(), shard.samples.end(),
+             back_inserter(*samples));
+        labels->insert(labels->end(), shard.labels.begin(),
+                       shard.labels.end());
+        counts->insert(counts->end(), shard.counts.begin(),
+                       shard.counts.end());
+        vector<sample_type>().swap(shard.samples);
+    }
+}
+
+// Streaming pass that estimates how often each token occurs at each context
+// position of an eos candidate. All threads add to the same sketch, so it
+// takes 4 x 2^width_bits counters regardless of the number of threads.
+static feature_count_sketch *count_features(const model_params &params,
+                                            const vector<string> &lines,
+                                            int n_threads,
+                                            unsigned width_bits) {
+    vector<pair<unsigned, unsigned>> ranges =
+        split_lines(lines, 0, lines.size(), n_threads);
+    unique_ptr<feature_count_sketch> sketch(
+            new feature_count_sketch(width_bits));
+    run_parallel(n_threads, [&](int shard_idx) {
+        for_each_candidate(params, lines, ranges[shard_idx].first,
+                           ranges[shard_idx].second,
+                           [&](const sbd_context &context, double) {
+            for (int k = -sbd_context::context_left;
+                 k <= sbd_context::context_right; ++k) {
+                // Empty tokens before the start of the corpus are features
+                // too, so they are counted like the rest.
+                sketch->add(context.get_token(k), k);
+            }
+        });
+    });
+    return sketch.release();
+}
+
+static vector<string> read_lines(const string &train_path) {
+    vector<string> lines;
+    if (compressed_input::is_compressed(train_path)) {
+        // Lines are split off while the next blocks are decompressed.
+        compressed_input in(train_path);
+        vector<char> buf(1 << 16);
+        string line;
+        for (size_t n; (n = in.read(&buf[0], buf.size())) != 0; ) {
+            const char *p = &buf[0], *e = p + n;
+            for (const char *nl; (nl = static_cast<const char *>(
+                            memchr(p, '\n', e - p))) != 0; p = nl + 1) {
+                line.append(p, nl);
+                lines.push_back(move(line));
+                line.clear();
+            }
+            line.append(p, e);
+        }
+        if (!line.empty()) {
+            lines.push_back(move(line));
+        }
+        return move(lines);
+    }
+    ifstream ifs(train_path);
+    if (!ifs.good()) {
+        throw runtime_error ("Can't train file.");
+    }
+    for (string line; getline(ifs, line); ) {
+        lines.push_back(line);
+    }
+    return move(lines);
+}
+
+// Extracts the samples of the training text. When chunk_bytes is nonzero,
+// the lines are extracted in chunks of about that many bytes and
+// end_of_chunk is called after each of them, so that it can consume the
+// samples. The samples are the same either way.
+template<class F>
+static void generate_features(
+        model_params &params,
+        const string &train_path,
+        const sbd_train_options &options,
+        size_t chunk_bytes,
+        vector<sample_type> *samples,
+        vector<double> *labels,
+        vector<int> *counts,
+        F end_of_chunk) {
+    vector<string> lines = read_lines(train_path);
+    // A warm started model keeps its eos chars.
+    if (params.get_eos_chars().empty()) {
+        params.set_eos_chars(collect_eos_chars(
+                    lines, options.eos_char_min_frequency));
+    }
+    int n_threads = options.n_threads;
+    if (lines.size() < static_cast<unsigned>(n_threads)) {
+        n_threads = 1;
+    }
+    unique_ptr<feature_count_sketch> sketch;
+    if (options.vocabulary_sketch_bits && !params.get_hash_bits()) {
+        sketch.reset(count_features(params, lines, n_threads,
+                                    options.vocabulary_sketch_bits));
+    }
+    size_t n_chunks = 1;
+    if (chunk_bytes) {
+        size_t total_size = 0;
+        for (unsigned i = 0; i < lines.size(); ++i) {
+            total_size += lines[i].size() + 1;
+        }
+        n_chunks = max<size_t>(1, total_size / chunk_bytes);
+    }
+    vector<pair<unsigned, unsigned>> chunks =
+        split_lines(lines, 0, lines.size(), n_chunks);
+    for (unsigned c = 0; c < chunks.size(); ++c) {
+        unsigned first = chunks[c].first, last = chunks[c].second;
+        if (n_threads > 1 &&
+            last - first >= static_cast<unsigned>(n_threads)) {
+            generate_features_parallel(params, lines,
+                                       split_lines(lines, first, last,
+                                                   n_threads), options,
+                                       sketch.get(), samples, labels, counts);
+        } else {
+            extract_samples(params, params, lines, first, last, options,
+                            sketch.get(), samples, labels, counts);
+        }
+        end_of_chunk();
+    }
     // ignore last sample
 }
 
@@ -577,6 +1159,7 @@ private:
 };
 
 static void remove_low_frequency_features(vector<sample_type> &samples,
+                                          const vector<int> &counts,
                                           int min_frequency) {
     vector<int> count;
     for (unsigned sample_idx = 0; sample_idx < samples.size();
@@ -586,7 +1169,7 @@ static void remove_low_frequency_features(vector<sample_type> &samples,
             if (sample[i].first >= count.size()) {
                 count.resize(sample[i].first + 1);
             }
-            ++count[sample[i].first];
+            count[sample[i].first] += counts[sample_idx];
         }
     }
 
@@ -600,95 +1183,1066 @@ static void remove_low_frequency_features(vector<sample_type> &samples,
     }
 }
 
-static sample_type my_train(const vector<sample_type> &samples,
-                            const vector<double> &y) {
-    int m = samples.size();
+static int samples_dimension(const vector<sample_type> &samples) {
     int n = 0;
-    for (int i = 0; i < m; ++i) {
+    for (unsigned i = 0; i < samples.size(); ++i) {
         int cur_dim = samples[i].back().first;
         if (cur_dim > n) {
             n = cur_dim;
         }
     }
-    ++n;
-    double lambda = 1e-4;
+    return n + 1;
+}
+
+// Holds out a fraction of the samples and evaluates F1 on them after every
+// epoch. Training stops once F1 hasn't improved by more than the tolerance
+// for a number of epochs, and the weights of the best epoch are kept.
+class validation_monitor {
+public:
+    validation_monitor(const vector<sample_type> &samples,
+                       const vector<double> &y,
+                       const vector<int> &counts,
+                       const sbd_train_options &options,
+                       mt19937 &rng,
+                       vector<int> *train_idx);
+
+    bool enabled() const;
+    template<class W>
+    bool end_of_epoch(const W &w, double w_scale);
+
+    int n_epochs() const;
+    double best_f1() const;
+    const sample_type &best_weights() const;
+private:
+    template<class W>
+    double f1(const W &w, double w_scale) const;
+
+    const vector<sample_type> &samples;
+    const vector<double> &y;
+    const vector<int> &counts;
+    vector<int> validation_idx;
+    double tolerance;
+    int patience;
+    int epochs;
+    int epochs_without_improvement;
+    double best;
+    sample_type best_w;
+};
+
+validation_monitor::validation_monitor(const vector<sample_type> &samples_,
+                                       const vector<double> &y_,
+                                       const vector<int> &counts_,
+                                       const sbd_train_options &options,
+                                       mt19937 &rng,
+                                       vector<int> *train_idx) :
+    samples(samples_), y(y_), counts(counts_),
+    tolerance(options.early_stopping_tolerance),
+    patience(options.early_stopping_patience), epochs(0),
+    epochs_without_improvement(0), best(-1) {
+    int m = samples.size();
+    train_idx->resize(m);
+    for (int i = 0; i < m; ++i) {
+        (*train_idx)[i] = i;
+    }
+    int n_validation = m * options.validation_fraction;
+    if (n_validation <= 0) {
+        return;
+    }
+    shuffle(train_idx->begin(), train_idx->end(), rng);
+    validation_idx.assign(train_idx->end() - n_validation, train_idx->end());
+    train_idx->resize(m - n_validation);
+    sort(train_idx->begin(), train_idx->end());
+    sort(validation_idx.begin(), validation_idx.end());
+}
+
+inline bool validation_monitor::enabled() const {
+    return !validation_idx.empty();
+}
+
+template<class W>
+double validation_monitor::f1(const W &w, double w_scale) const {
+    int tp = 0, fp = 0, fn = 0;
+    for (unsigned i = 0; i < validation_idx.size(); ++i) {
+        const sample_type &sample = samples[validation_idx[i]];
+        double dot_p = 0;
+        for (unsigned j = 0; j < sample.size(); ++j) {
+            dot_p += static_cast<float>(w[sample[j].first]);
+        }
+        bool predicted = dot_p * w_scale > 0;
+        bool actual = y[validation_idx[i]] > 0;
+        int count = counts[validation_idx[i]];
+        tp += (predicted && actual) * count;
+        fp += (predicted && !actual) * count;
+        fn += (!predicted && actual) * count;
+    }
+    return tp ? static_cast<double>(2 * tp) / (2 * tp + fp + fn) : 0.;
+}
+
+template<class W>
+bool validation_monitor::end_of_epoch(const W &w, double w_scale) {
+    ++epochs;
+    if (!enabled()) {
+        return false;
+    }
+    double cur_f1 = f1(w, w_scale);
+    if (cur_f1 > best + tolerance) {
+        epochs_without_improvement = 0;
+    } else {
+        ++epochs_without_improvement;
+    }
+    if (cur_f1 > best) {
+        best = cur_f1;
+        best_w.clear();
+        for (unsigned i = 0; i < w.size(); ++i) {
+            float v = static_cast<float>(w[i]) * w_scale;
+            if (v) {
+                best_w.emplace_back(i, v);
+            }
+        }
+    }
+    return epochs_without_improvement >= patience;
+}
+
+inline int validation_monitor::n_epochs() const {
+    return epochs;
+}
+
+inline double validation_monitor::best_f1() const {
+    return best;
+}
+
+inline const sample_type &validation_monitor::best_weights() const {
+    return best_w;
+}
+
+// Step size equivalent to count consecutive hinge loss updates on the same
+// sample, which stop once its margin reaches 1.
+static double weighted_step(double eta, int count, double margin,
+                            int n_features) {
+    if (count == 1) {
+        return eta;
+    }
+    return min(count * eta, max(eta, (1 - margin) / n_features));
+}
+
+// Hinge loss SGD with L2 regularization. The weights are w * w_scale, so
+// the regularization decays all of them in constant time.
+class sgd_trainer {
+public:
+    sgd_trainer(int n, const sbd_train_options &options);
+
+    // Starts from the initial weights instead of zero, at the warm start
+    // learning rate. With a nonzero prior_regularization the weights are
+    // w * w_scale + initial, so that the regularization (that many times
+    // stronger than usual) pulls them toward the initial weights instead of
+    // zero.
+    void warm_start(const vector<float> &initial,
+                    const sbd_train_options &options);
+    void update(const sample_type &sample, double cur_y, int count);
+    // Folds w_scale into w once it gets small. Called between epochs.
+    void normalize();
+    // Normalizes and reports the epoch to the monitor.
+    bool end_of_epoch(validation_monitor &monitor);
+    sample_type weights();
+private:
+    vector<float> current_weights() const;
+
+    vector<float> w;
+    double w_scale;
+    vector<float> prior;
+    double prior_regularization;
+    double lambda;
+    double eta0;
+    double t;
+};
+
+sgd_trainer::sgd_trainer(int n, const sbd_train_options &options) :
+    w(n), w_scale(1), prior_regularization(0),
+    lambda(options.regularization), eta0(options.learning_rate), t(0) {
+}
+
+void sgd_trainer::warm_start(const vector<float> &initial,
+                             const sbd_train_options &options) {
+    if (initial.size() > w.size()) {
+        w.resize(initial.size());
+    }
+    w_scale = 1;
+    eta0 = options.warm_start_learning_rate;
+    prior_regularization = options.prior_regularization;
+    if (prior_regularization) {
+        prior = initial;
+        prior.resize(w.size());
+    } else {
+        copy(initial.begin(), initial.end(), w.begin());
+    }
+}
+
+void sgd_trainer::update(const sample_type &sample, double cur_y,
+                         int count) {
+    double eta = eta0 / (1 + lambda * eta0 * t);
+
+    t += count;
+    double decay = count * eta * lambda * 0.01;
+    if (!prior.empty()) {
+        decay *= prior_regularization;
+    }
+    w_scale *= 1 - decay;
+    double dot_p = 0;
+    for (unsigned i = 0; i < sample.size(); ++i) {
+        dot_p += w[sample[i].first];// * sample[i].second;
+    }
+    dot_p = dot_p * w_scale;
+    if (!prior.empty()) {
+        for (unsigned i = 0; i < sample.size(); ++i) {
+            dot_p += prior[sample[i].first];
+        }
+    }
+
+    /*// <logistic regression>
+    double tmp = cur_y / (1 + exp(dot_p * cur_y));
+    // </logistic regression> */
+
+    // <hinge loss>
+    // max(1 - w * x * y, 0)
+    if (dot_p * cur_y >= 1) {
+        return;
+    }
+    double tmp = cur_y;
+    // </hinge loss> */
+
+    tmp *= weighted_step(eta, count, dot_p * cur_y, sample.size()) /
+           w_scale;
+    for (unsigned i = 0; i < sample.size(); ++i) {
+        w[sample[i].first] += tmp;// * sample[i].second;
+    }
+}
+
+void sgd_trainer::normalize() {
+    if (w_scale < 0.1) {
+        for (unsigned i = 0; i < w.size(); ++i) {
+            w[i] *= w_scale;
+        }
+        w_scale = 1;
+    }
+}
+
+bool sgd_trainer::end_of_epoch(validation_monitor &monitor) {
+    normalize();
+    if (!prior.empty() && monitor.enabled()) {
+        return monitor.end_of_epoch(current_weights(), 1.);
+    }
+    return monitor.end_of_epoch(w, w_scale);
+}
+
+vector<float> sgd_trainer::current_weights() const {
+    vector<float> rez(w.size());
+    for (unsigned i = 0; i < w.size(); ++i) {
+        rez[i] = w[i] * w_scale;
+        if (!prior.empty()) {
+            rez[i] += prior[i];
+        }
+    }
+    return move(rez);
+}
+
+sample_type sgd_trainer::weights() {
+    w = current_weights();
+    w_scale = 1;
+    prior.clear();
+    sample_type w_sparse;
+    for (unsigned i = 0; i < w.size(); ++i) {
+        if (w[i]) {
+            w_sparse.emplace_back(i, w[i]);
+        }
+    }
+    return move(w_sparse);
+}
+
+static sample_type my_train(const vector<sample_type> &samples,
+                            const vector<double> &y,
+                            const vector<int> &counts,
+                            const sbd_train_options &options,
+                            const vector<float> *initial_weights,
+                            validation_monitor &monitor,
+                            const vector<int> &train_idx,
+                            mt19937 &rng) {
+    int m = train_idx.size();
+    sgd_trainer sgd(samples_dimension(samples), options);
+    if (initial_weights) {
+        sgd.warm_start(*initial_weights, options);
+    }
+    vector<int> perm(train_idx);
+    for (int iter = 0; iter < options.n_epochs; ++iter) {
+        shuffle(perm.begin(), perm.end(), rng);
+
+        for (int i = 0; i < m; ++i) {
+            int cur_idx = perm[i];
+            sgd.update(samples[cur_idx], y[cur_idx], counts[cur_idx]);
+        }
+        if (sgd.end_of_epoch(monitor)) {
+            break;
+        }
+    }
+    if (monitor.enabled()) {
+        return monitor.best_weights();
+    }
+    return sgd.weights();
+}
 
-    vector<float> w(n);
-    vector<int> perm(m);
+// Lock-free (Hogwild) variant of my_train. Samples are sparse, so threads
+// rarely touch the same weights and update the shared vector without
+// locking. Each thread runs its own learning rate schedule and decays its
+// own copy of w_scale, as if the other threads' steps were interleaved with
+// its own. The scales are merged and normalized between epochs.
+static sample_type my_train_parallel(const vector<sample_type> &samples,
+                                     const vector<double> &y,
+                                     const vector<int> &counts,
+                                     const sbd_train_options &options,
+                                     validation_monitor &monitor,
+                                     const vector<int> &train_idx,
+                                     mt19937 &rng) {
+    int n_threads = options.n_train_threads;
+    int m = train_idx.size();
+    int n = samples_dimension(samples);
+    double lambda = options.regularization;
+
+    vector<atomic<float>> w(n);
+    for (int i = 0; i < n; ++i) {
+        w[i].store(0, memory_order_relaxed);
+    }
+    vector<int> perm(train_idx);
+    double epoch_count = 0;
     for (int i = 0; i < m; ++i) {
-        perm[i] = i;
+        epoch_count += counts[perm[i]];
     }
-    double eta0 = 1;
+    double eta0 = options.learning_rate;
     double t = 0;
     double w_scale = 1;
-    for (int iter = 0; iter < 100; ++iter) {
-        random_shuffle(perm.begin(), perm.end());
+    vector<double> thread_scale(n_threads);
+    for (int iter = 0; iter < options.n_epochs; ++iter) {
+        shuffle(perm.begin(), perm.end(), rng);
+
+        run_parallel(n_threads, [&](int thread_idx) {
+            int first = static_cast<int64_t>(m) * thread_idx / n_threads;
+            int last = static_cast<int64_t>(m) * (thread_idx + 1) / n_threads;
+            double cur_t = t + thread_idx;
+            double cur_scale = w_scale;
+            for (int i = first; i < last; ++i) {
+                double eta = eta0 / (1 + lambda * eta0 * cur_t);
+
+                int cur_idx = perm[i];
+                const sample_type &sample = samples[cur_idx];
+                double cur_y = y[cur_idx];
+                int count = counts[cur_idx];
+                cur_t += n_threads * count;
+                cur_scale *= 1 - n_threads * count * eta * lambda * 0.01;
+                double dot_p = 0;
+                for (unsigned j = 0; j < sample.size(); ++j) {
+                    dot_p += w[sample[j].first].load(memory_order_relaxed);
+                }
+                dot_p = dot_p * cur_scale;
 
-        for (int i = 0; i < m; ++i, ++t) {
-            double eta = eta0 / (1 + lambda * eta0 * t);
+                // Hinge loss: max(1 - w * x * y, 0).
+                if (dot_p * cur_y >= 1) {
+                    continue;
+                }
+                double tmp = cur_y * weighted_step(
+                        eta, count, dot_p * cur_y, sample.size()) / cur_scale;
+                for (unsigned j = 0; j < sample.size(); ++j) {
+                    atomic<float> &cur_w = w[sample[j].first];
+                    cur_w.store(cur_w.load(memory_order_relaxed) + tmp,
+                                memory_order_relaxed);
+                }
+            }
+            thread_scale[thread_idx] = cur_scale;
+        });
+        t += epoch_count;
+        w_scale = accumulate(thread_scale.begin(), thread_scale.end(), 0.) /
+                  n_threads;
+        if (w_scale < 0.1) {
+            for (int i = 0; i < n; ++i) {
+                w[i].store(w[i].load(memory_order_relaxed) * w_scale,
+                           memory_order_relaxed);
+            }
+            w_scale = 1;
+        }
+        if (monitor.end_of_epoch(w, w_scale)) {
+            break;
+        }
+    }
+    if (monitor.enabled()) {
+        return monitor.best_weights();
+    }
+    sample_type w_sparse;
+    for (int i = 0; i < n; ++i) {
+        float v = w[i].load(memory_order_relaxed) * w_scale;
+        if (v) {
+            w_sparse.emplace_back(i, v);
+        }
+    }
+    return move(w_sparse);
+}
 
-            int cur_idx = perm[i];
+// Dual coordinate descent for the L2-regularized hinge loss (Hsieh et al.,
+// "A Dual Coordinate Descent Method for Large-scale Linear SVM", 2008), as
+// used by liblinear. Unlike SGD it usually converges in a few passes.
+static sample_type my_train_dual_cd(const vector<sample_type> &samples,
+                                    const vector<double> &y,
+                                    const vector<int> &counts,
+                                    const sbd_train_options &options,
+                                    validation_monitor &monitor,
+                                    const vector<int> &train_idx,
+                                    mt19937 &rng) {
+    int m = train_idx.size();
+    int n = samples_dimension(samples);
+    double c = options.dual_cd_cost;
+    double eps = 0.1;
+
+    vector<double> w(n);
+    vector<double> alpha(samples.size());
+    vector<int> active(train_idx);
+    int n_active = m;
+    // Samples whose projected gradient stays outside of these bounds are
+    // shrunk away until the active set converges.
+    double pg_max_old = HUGE_VAL, pg_min_old = -HUGE_VAL;
+    for (int iter = 0; iter < options.n_epochs; ++iter) {
+        shuffle(active.begin(), active.begin() + n_active, rng);
+
+        double pg_max = -HUGE_VAL, pg_min = HUGE_VAL;
+        for (int i = 0; i < n_active; ++i) {
+            int cur_idx = active[i];
             const sample_type &sample = samples[cur_idx];
             double cur_y = y[cur_idx];
-            w_scale *= 1 - eta * lambda * 0.01;
+            double upper = c * counts[cur_idx];
             double dot_p = 0;
-            for (unsigned i = 0; i < sample.size(); ++i) {
-                dot_p += w[sample[i].first];// * sample[i].second;
+            for (unsigned j = 0; j < sample.size(); ++j) {
+                dot_p += w[sample[j].first];
             }
-            dot_p = dot_p * w_scale;
-
-            /*// <logistic regression>
-            double tmp = cur_y / (1 + exp(dot_p * cur_y));
-            // </logistic regression> */
-
-            // <hinge loss>
-            // max(1 - w * x * y, 0)
-            if (dot_p * cur_y >= 1) {
+            double g = cur_y * dot_p - 1;
+            double &a = alpha[cur_idx];
+            double pg = 0;
+            if (a == 0) {
+                if (g > pg_max_old) {
+                    swap(active[i--], active[--n_active]);
+                    continue;
+                }
+                pg = min(g, 0.);
+            } else if (a == upper) {
+                if (g < pg_min_old) {
+                    swap(active[i--], active[--n_active]);
+                    continue;
+                }
+                pg = max(g, 0.);
+            } else {
+                pg = g;
+            }
+            pg_max = max(pg_max, pg);
+            pg_min = min(pg_min, pg);
+            if (fabs(pg) < 1e-12) {
                 continue;
             }
-            double tmp = cur_y;
-            // </hinge loss> */
-
-            tmp *= eta / w_scale;
-            for (unsigned i = 0; i < sample.size(); ++i) {
-                w[sample[i].first] += tmp;// * sample[i].second;
+            double old_a = a;
+            a = min(max(a - g / sample.size(), 0.), upper);
+            double tmp = (a - old_a) * cur_y;
+            for (unsigned j = 0; j < sample.size(); ++j) {
+                w[sample[j].first] += tmp;
             }
         }
-        if (w_scale < 0.1) {
-            for (int i = 0; i < n; ++i) {
-                w[i] *= w_scale;
+        if (monitor.end_of_epoch(w, 1.)) {
+            break;
+        }
+        if (pg_max - pg_min < eps) {
+            if (n_active == m) {
+                break;
             }
-            w_scale = 1;
+            n_active = m;
+            pg_max_old = HUGE_VAL;
+            pg_min_old = -HUGE_VAL;
+            continue;
         }
+        pg_max_old = pg_max > 0 ? pg_max : HUGE_VAL;
+        pg_min_old = pg_min < 0 ? pg_min : -HUGE_VAL;
     }
-    for (int i = 0; i < n; ++i) {
-        w[i] *= w_scale;
+    if (monitor.enabled()) {
+        return monitor.best_weights();
     }
     sample_type w_sparse;
     for (int i = 0; i < n; ++i) {
-        if (w[i]) {
-            w_sparse.emplace_back(i, w[i]);
+        float v = w[i];
+        if (v) {
+            w_sparse.emplace_back(i, v);
         }
     }
     return move(w_sparse);
 }
 
-static void train_params(model_params &params, const string &train_path) {
+// Binary cache of the extracted samples, so that training can be repeated
+// (and streamed) without tokenizing the corpus again. All integers are LEB128
+// varints:
+//   magic
+//   eos chars: count, code points
+//   number of word classes, hash bits
+//   vocabulary: count, then token length, token and classes mask for each
+//     token (bucket index and classes mask for hashed models)
+//   samples: count, then label (0 or 1), count, number of features and the
+//     deltas between consecutive (sorted) feature ids for each sample
+// Samples are stored before dropping low frequency features.
+static const char sample_cache_magic[] = "SBDSAMPLES1\n";
+
+static void write_varint(string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+static uint64_t read_varint(const char *&p, const char *end) {
+    uint64_t v = 0;
+    for (int shift = 0; p != end && shift < 64; shift += 7) {
+        unsigned char c = *p++;
+        v |= static_cast<uint64_t>(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            return v;
+        }
+    }
+    throw runtime_error("Truncated sample cache.");
+}
+
+// Appends the eos chars, word classes and vocabulary to buf.
+static void write_cache_params(string &buf, const model_params &params) {
+    const vector<char32_t> &eos_chars = params.get_eos_chars();
+    write_varint(buf, eos_chars.size());
+    for (unsigned i = 0; i < eos_chars.size(); ++i) {
+        write_varint(buf, eos_chars[i]);
+    }
+    write_varint(buf, params.word_class_features.size());
+    write_varint(buf, params.get_hash_bits());
+    if (params.get_hash_bits()) {
+        vector<unsigned> buckets;
+        for (unsigned i = 0; i < params.token_features.size(); ++i) {
+            if (params.token_features[i].classes_mask) {
+                buckets.push_back(i);
+            }
+        }
+        write_varint(buf, buckets.size());
+        for (unsigned i = 0; i < buckets.size(); ++i) {
+            write_varint(buf, buckets[i]);
+            write_varint(buf,
+                         params.token_features[buckets[i]].classes_mask);
+        }
+    } else {
+        write_varint(buf, params.token_features.size());
+        for (unsigned i = 0; i < params.token_features.size(); ++i) {
+            const utf8_slice &token = params.tokens[i];
+            write_varint(buf, token.size());
+            buf.append(token.ptr(), token.size());
+            write_varint(buf, params.token_features[i].classes_mask);
+        }
+    }
+}
+
+// Appends the samples to buf, writing it to out whenever it gets large.
+static void write_cache_samples(ostream &out, string &buf,
+                                const vector<sample_type> &samples,
+                                const vector<double> &labels,
+                                const vector<int> &counts) {
+    for (unsigned sample_idx = 0; sample_idx < samples.size();
+         ++sample_idx) {
+        const sample_type &sample = samples[sample_idx];
+        buf.push_back(labels[sample_idx] > 0);
+        write_varint(buf, counts[sample_idx]);
+        write_varint(buf, sample.size());
+        unsigned prev = 0;
+        for (unsigned i = 0; i < sample.size(); ++i) {
+            if (sample[i].first < prev) {
+                throw runtime_error("Sample features aren't sorted.");
+            }
+            write_varint(buf, sample[i].first - prev);
+            prev = sample[i].first;
+        }
+        if (buf.size() >= 1 << 20) {
+            out.write(buf.data(), buf.size());
+            buf.clear();
+        }
+    }
+}
+
+static void write_sample_cache(const string &path,
+                               const model_params &params,
+                               const vector<sample_type> &samples,
+                               const vector<double> &labels,
+                               const vector<int> &counts) {
+    ofstream ofs(path, ios_base::binary);
+    if (!ofs.good()) {
+        throw runtime_error("Can't open sample cache file.");
+    }
+    string buf(sample_cache_magic);
+    write_cache_params(buf, params);
+    write_varint(buf, samples.size());
+    write_cache_samples(ofs, buf, samples, labels, counts);
+    ofs.write(buf.data(), buf.size());
+    if (!ofs.good()) {
+        throw runtime_error("Error while writing sample cache file.");
+    }
+}
+
+// Lines extracted at a time when streaming samples into the sample cache.
+static const size_t sample_cache_chunk_bytes = 16 << 20;
+
+// Extracts the samples into the sample cache chunk by chunk, so that only
+// one chunk of them is in memory at a time. The vocabulary, which precedes
+// the samples in the cache, is only complete at the end, so the samples go
+// to a temporary file first.
+static void stream_sample_cache(model_params &params,
+                                const string &train_path,
+                                const sbd_train_options &options) {
+    const string &path = options.sample_cache_path;
+    string samples_path = path + ".samples";
+    try {
+        ofstream samples_ofs(samples_path, ios_base::binary);
+        if (!samples_ofs.good()) {
+            throw runtime_error("Can't open sample cache file.");
+        }
+        vector<double> labels;
+        vector<sample_type> samples;
+        vector<int> counts;
+        uint64_t n_samples = 0;
+        string buf;
+        generate_features(params, train_path, options,
+                          sample_cache_chunk_bytes, &samples, &labels,
+                          &counts, [&]() {
+            n_samples += samples.size();
+            write_cache_samples(samples_ofs, buf, samples, labels, counts);
+            samples.clear();
+            labels.clear();
+            counts.clear();
+        });
+        samples_ofs.write(buf.data(), buf.size());
+        samples_ofs.close();
+
+        ofstream ofs(path, ios_base::binary);
+        ifstream samples_ifs(samples_path, ios_base::binary);
+        if (!samples_ofs.good() || !ofs.good() || !samples_ifs.good()) {
+            throw runtime_error("Error while writing sample cache file.");
+        }
+        buf = sample_cache_magic;
+        write_cache_params(buf, params);
+        write_varint(buf, n_samples);
+        ofs.write(buf.data(), buf.size());
+        if (n_samples) {
+            ofs << samples_ifs.rdbuf();
+        }
+        if (!ofs.good()) {
+            throw runtime_error("Error while writing sample cache file.");
+        }
+    } catch (...) {
+        remove(samples_path.c_str());
+        throw;
+    }
+    remove(samples_path.c_str());
+}
+
+// Memory mapped sample cache. Samples are decoded one at a time, so
+// iterating over them doesn't need more memory than the largest sample.
+class sample_cache_reader {
+public:
+    explicit sample_cache_reader(const string &path);
+
+    // Restores eos chars, word classes and the vocabulary. params must be
+    // empty.
+    void read_params(model_params &params) const;
+
+    unsigned size() const;
+    const char *samples_begin() const;
+    const char *samples_end() const;
+    // Decodes the sample at p and advances p past it.
+    void read_sample(const char *&p, sample_type *sample, double *label,
+                     int *count) const;
+    void read_samples(vector<sample_type> *samples, vector<double> *labels,
+                      vector<int> *counts) const;
+private:
+    mapped_file file;
+    const char *params_start;
+    const char *samples_start;
+    unsigned n_samples;
+};
+
+sample_cache_reader::sample_cache_reader(const string &path) :
+    file(path), params_start(0), samples_start(0), n_samples(0) {
+    const char *p = file.data();
+    const char *end = p + file.size();
+    size_t magic_size = sizeof(sample_cache_magic) - 1;
+    if (file.size() < magic_size ||
+        memcmp(p, sample_cache_magic, magic_size)) {
+        throw runtime_error("Not a sample cache file.");
+    }
+    p += magic_size;
+    params_start = p;
+
+    // Skip over the parameters to find the samples.
+    uint64_t n = read_varint(p, end);
+    for (uint64_t i = 0; i < n; ++i) {
+        read_varint(p, end);
+    }
+    read_varint(p, end);
+    bool hashed = read_varint(p, end) != 0;
+    n = read_varint(p, end);
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t len = read_varint(p, end);
+        if (!hashed) {
+            if (len > static_cast<uint64_t>(end - p)) {
+                throw runtime_error("Truncated sample cache.");
+            }
+            p += len;
+        }
+        read_varint(p, end);
+    }
+    n_samples = read_varint(p, end);
+    samples_start = p;
+}
+
+void sample_cache_reader::read_params(model_params &params) const {
+    const char *p = params_start;
+    const char *end = samples_start;
+
+    vector<char32_t> eos_chars(read_varint(p, end));
+    for (unsigned i = 0; i < eos_chars.size(); ++i) {
+        eos_chars[i] = read_varint(p, end);
+    }
+    params.set_eos_chars(eos_chars);
+    params.word_class_features.resize(read_varint(p, end));
+    for (unsigned i = 0; i < params.word_class_features.size(); ++i) {
+        params.word_class_features[i].fill(0.);
+    }
+    unsigned hash_bits = read_varint(p, end);
+    if (hash_bits > sbd_train_options::max_hash_bits) {
+        throw runtime_error("Invalid hash bits in sample cache.");
+    }
+    params.set_hash_bits(hash_bits);
+    uint64_t n = read_varint(p, end);
+    for (uint64_t i = 0; i < n; ++i) {
+        int idx;
+        if (hash_bits) {
+            idx = read_varint(p, end);
+            if (static_cast<unsigned>(idx) >= params.token_features.size()) {
+                throw runtime_error("Invalid bucket in sample cache.");
+            }
+        } else {
+            unsigned len = read_varint(p, end);
+            idx = params.get_or_add_feature(utf8_slice(p, len));
+            p += len;
+        }
+        params.token_features[idx].classes_mask = read_varint(p, end);
+    }
+}
+
+unsigned sample_cache_reader::size() const {
+    return n_samples;
+}
+
+const char *sample_cache_reader::samples_begin() const {
+    return samples_start;
+}
+
+const char *sample_cache_reader::samples_end() const {
+    return file.data() + file.size();
+}
+
+void sample_cache_reader::read_sample(const char *&p, sample_type *sample,
+                                      double *label, int *count) const {
+    const char *end = samples_end();
+    if (p == end) {
+        throw runtime_error("Truncated sample cache.");
+    }
+    *label = *p++ ? 1 : -1;
+    *count = read_varint(p, end);
+    unsigned n = read_varint(p, end);
+    sample->clear();
+    unsigned feature = 0;
+    for (unsigned i = 0; i < n; ++i) {
+        feature += read_varint(p, end);
+        sample->emplace_back(feature, 1.);
+    }
+}
+
+void sample_cache_reader::read_samples(vector<sample_type> *samples,
+                                       vector<double> *labels,
+                                       vector<int> *counts) const {
+    file.advise_sequential();
+    samples->resize(n_samples);
+    labels->resize(n_samples);
+    counts->resize(n_samples);
+    const char *p = samples_begin();
+    for (unsigned i = 0; i < n_samples; ++i) {
+        read_sample(p, &(*samples)[i], &(*labels)[i], &(*counts)[i]);
+    }
+}
+
+// my_train on samples streamed from a sample cache. Only the weights and one
+// chunk of samples are held in memory. Each epoch visits the chunks in a
+// random order and shuffles the samples within each chunk, which
+// approximates a full shuffle as long as the corpus has many chunks.
+static sample_type my_train_streaming(const sample_cache_reader &cache,
+                                      const sbd_train_options &options,
+                                      const vector<float> *initial_weights,
+                                      sbd_train_stats *stats) {
+    const unsigned chunk_size = 1 << 16;
+
+    // First pass: feature frequencies and chunk boundaries.
+    vector<int> feature_count;
+    vector<const char *> chunk_start;
+    int n_samples = 0;
+    sample_type sample;
+    double label;
+    int count;
+    const char *p = cache.samples_begin();
+    for (unsigned i = 0; i < cache.size(); ++i) {
+        if (i % chunk_size == 0) {
+            chunk_start.push_back(p);
+        }
+        cache.read_sample(p, &sample, &label, &count);
+        n_samples += count;
+        for (unsigned j = 0; j < sample.size(); ++j) {
+            if (sample[j].first >= feature_count.size()) {
+                feature_count.resize(sample[j].first + 1);
+            }
+            feature_count[sample[j].first] += count;
+        }
+    }
+    chunk_start.push_back(p);
+    int n_chunks = chunk_start.size() - 1;
+
+    auto train_start = chrono::steady_clock::now();
+    sgd_trainer sgd(feature_count.size(), options);
+    if (initial_weights) {
+        sgd.warm_start(*initial_weights, options);
+    }
+    sample_frequency_threshold is_rare(feature_count,
+                                       options.min_feature_frequency);
+    vector<int> chunk_perm(n_chunks);
+    iota(chunk_perm.begin(), chunk_perm.end(), 0);
+    vector<sample_type> samples;
+    vector<double> labels;
+    vector<int> counts;
+    vector<int> perm;
+    mt19937 rng(options.seed);
+    for (int iter = 0; iter < options.n_epochs; ++iter) {
+        shuffle(chunk_perm.begin(), chunk_perm.end(), rng);
+        for (int c = 0; c < n_chunks; ++c) {
+            samples.clear();
+            labels.clear();
+            counts.clear();
+            p = chunk_start[chunk_perm[c]];
+            while (p != chunk_start[chunk_perm[c] + 1]) {
+                cache.read_sample(p, &sample, &label, &count);
+                sample.erase(remove_if(sample.begin(), sample.end(), is_rare),
+                             sample.end());
+                samples.push_back(sample);
+                labels.push_back(label);
+                counts.push_back(count);
+            }
+            perm.resize(samples.size());
+            iota(perm.begin(), perm.end(), 0);
+            shuffle(perm.begin(), perm.end(), rng);
+            for (unsigned i = 0; i < perm.size(); ++i) {
+                sgd.update(samples[perm[i]], labels[perm[i]],
+                           counts[perm[i]]);
+            }
+        }
+        sgd.normalize();
+    }
+    if (stats) {
+        stats->n_samples = n_samples;
+        stats->n_unique_samples = cache.size();
+        stats->n_epochs = options.n_epochs;
+        stats->validation_f1 = -1;
+        stats->train_seconds = chrono::duration<double>(
+                chrono::steady_clock::now() - train_start).count();
+        stats->seconds_saved = 0;
+    }
+    return sgd.weights();
+}
+
+static void check_out_of_core_options(const sbd_train_options &options) {
+    if (options.optimizer != sbd_optimizer::sgd ||
+        options.n_train_threads > 1 || options.validation_fraction > 0 ||
+        options.deduplicate_samples) {
+        throw runtime_error("Out of core training only supports "
+                            "single threaded SGD without validation or "
+                            "deduplication.");
+    }
+}
+
+static void check_warm_start_options(const sbd_train_options &options) {
+    if (options.optimizer != sbd_optimizer::sgd ||
+        options.n_train_threads > 1) {
+        throw runtime_error("Warm start only supports single threaded SGD.");
+    }
+}
+
+static void set_weights(model_params &params, const sample_type &weights);
+
+static void train_samples(model_params &params,
+                          vector<sample_type> &samples,
+                          vector<double> &labels,
+                          vector<int> &counts,
+                          const sbd_train_options &options,
+                          const vector<float> *initial_weights,
+                          sbd_train_stats *stats) {
+    if (options.optimizer == sbd_optimizer::dual_coordinate_descent &&
+        options.n_train_threads > 1) {
+        throw runtime_error("Dual coordinate descent is single threaded.");
+    }
+    remove_low_frequency_features(samples, counts,
+                                  options.min_feature_frequency);
+    if (options.deduplicate_samples) {
+        // Dropping rare features makes many more samples identical.
+        deduplicate_samples(samples, labels, counts);
+    }
+
+    auto train_start = chrono::steady_clock::now();
+    vector<int> train_idx;
+    mt19937 rng(options.seed);
+    validation_monitor monitor(samples, labels, counts, options, rng,
+                               &train_idx);
+    sample_type weights;
+    if (options.optimizer == sbd_optimizer::dual_coordinate_descent) {
+        weights = my_train_dual_cd(samples, labels, counts, options,
+                                   monitor, train_idx, rng);
+    } else if (options.n_train_threads > 1) {
+        weights = my_train_parallel(samples, labels, counts, options,
+                                    monitor, train_idx, rng);
+    } else {
+        weights = my_train(samples, labels, counts, options,
+                           initial_weights, monitor, train_idx, rng);
+    }
+    if (stats) {
+        stats->n_tokens = params.token_features.size();
+        stats->n_samples = accumulate(counts.begin(), counts.end(), 0);
+        stats->n_unique_samples = samples.size();
+        stats->n_epochs = monitor.n_epochs();
+        stats->validation_f1 = monitor.enabled() ? monitor.best_f1() : -1;
+        stats->train_seconds = chrono::duration<double>(
+                chrono::steady_clock::now() - train_start).count();
+        stats->seconds_saved = stats->train_seconds / stats->n_epochs *
+            (options.n_epochs - stats->n_epochs);
+    }
+    set_weights(params, weights);
+}
+
+static void train_from_cache(model_params &params,
+                             const sample_cache_reader &cache,
+                             const sbd_train_options &options,
+                             const vector<float> *initial_weights,
+                             sbd_train_stats *stats) {
+    if (options.out_of_core) {
+        sample_type weights = my_train_streaming(cache, options,
+                                                 initial_weights, stats);
+        if (stats) {
+            stats->n_tokens = params.token_features.size();
+        }
+        set_weights(params, weights);
+        return;
+    }
     vector<double> labels;
     vector<sample_type> samples;
+    vector<int> counts;
+    cache.read_samples(&samples, &labels, &counts);
+    train_samples(params, samples, labels, counts, options, initial_weights,
+                  stats);
+}
 
-    generate_features(params, train_path, &samples, &labels);
-    remove_low_frequency_features(samples, 5);
-    sample_type weights = my_train(samples, labels);
+static void train_params(model_params &params, const string &train_path,
+                         const sbd_train_options &options,
+                         const vector<float> *initial_weights,
+                         sbd_train_stats *stats) {
+    if (options.out_of_core) {
+        check_out_of_core_options(options);
+        if (options.sample_cache_path.empty()) {
+            throw runtime_error("Out of core training needs a sample cache.");
+        }
+    }
+    if (options.out_of_core) {
+        stream_sample_cache(params, train_path, options);
+        sample_cache_reader cache(options.sample_cache_path);
+        train_from_cache(params, cache, options, initial_weights, stats);
+        return;
+    }
+    vector<double> labels;
+    vector<sample_type> samples;
+    vector<int> counts;
+
+    generate_features(params, train_path, options, 0, &samples, &labels,
+                      &counts, []() {});
+    if (!options.sample_cache_path.empty()) {
+        write_sample_cache(options.sample_cache_path, params, samples,
+                           labels, counts);
+    }
+    train_samples(params, samples, labels, counts, options, initial_weights,
+                  stats);
+}
+
+// Copies eos chars, word classes and the vocabulary (in the same order), but
+// not the weights. to must be empty.
+static void copy_vocabulary(const model_params &from, model_params &to) {
+    to.set_hash_bits(from.get_hash_bits());
+    to.set_eos_chars(from.get_eos_chars());
+    to.word_class_features.resize(from.word_class_features.size());
+    for (unsigned i = 0; i < to.word_class_features.size(); ++i) {
+        to.word_class_features[i].fill(0.);
+    }
+    for (unsigned i = 0; i < from.token_features.size(); ++i) {
+        int idx = from.get_hash_bits() ? i :
+            to.get_or_add_feature(from.tokens[i]);
+        to.token_features[idx].classes_mask =
+            from.token_features[i].classes_mask;
+    }
+}
+
+// Inverse of set_weights: the weights of params in the feature space used
+// for training.
+static vector<float> get_weights(const model_params &params) {
+    unsigned offset = token_features_offset(params);
+    vector<float> w(offset +
+                    params.token_features.size() * sbd_context::context_size);
+    w[0] = params.bias;
+    for (unsigned i = 0; i < params.global_features.size(); ++i) {
+        w[1 + i] = params.global_features[i];
+    }
+    unsigned idx = 1 + params.global_features.size();
+    for (unsigned i = 0; i < params.word_class_features.size(); ++i) {
+        for (int j = 0; j < sbd_context::context_size; ++j) {
+            w[idx++] = params.word_class_features[i][j];
+        }
+    }
+    for (unsigned i = 0; i < params.token_features.size(); ++i) {
+        for (int j = 0; j < sbd_context::context_size; ++j) {
+            w[idx++] = params.token_features[i].features[j];
+        }
+    }
+    return move(w);
+}
 
+// Moves the trained weights into params. Tokens without any nonzero weight
+// or class are dropped from the vocabulary.
+static void set_weights(model_params &params, const sample_type &weights) {
     unsigned bias_end = 1;
     unsigned global_features_end = bias_end + params.global_features.size();
     unsigned word_class_features_end = global_features_end +
         params.word_class_features.size() * sbd_context::context_size;
 
-    params.token_to_idx.clear();
-    vector<token_data> old_token_features = move(params.token_features);
-    params.token_features.clear();
+    // Hashed token features already are in their final place.
+    bool hashed = params.get_hash_bits() != 0;
+    vector<token_data> old_token_features;
+    vector<utf8_slice> old_tokens;
+    if (!hashed) {
+        params.token_to_idx.clear();
+        old_token_features = move(params.token_features);
+        params.token_features.clear();
+        old_tokens = move(params.tokens);
+        params.tokens.clear();
+    }
     for (unsigned i = 0; i < weights.size(); ++i) {
         unsigned idx = weights[i].first;
         double v = weights[i].second;
@@ -705,31 +2259,183 @@ static void train_params(model_params &params, const string &train_path) {
                 [tmp % sbd_context::context_size] = v;
         } else {
             int tmp = idx - word_class_features_end;
-            int new_idx = params.get_or_add_feature(
-                old_token_features[tmp / sbd_context::context_size].token);
+            int new_idx = tmp / sbd_context::context_size;
+            if (!hashed) {
+                new_idx = params.get_or_add_feature(old_tokens[new_idx]);
+            }
             params.token_features[new_idx].features
                 [tmp % sbd_context::context_size] = v;
         }
     }
     for (unsigned i = 0; i < old_token_features.size(); ++i) {
-        const token_data &t = old_token_features[i];
-        if (t.classes_mask) {
-            int idx = params.get_or_add_feature(t.token);
-            params.token_features[idx].classes_mask = t.classes_mask;
+        unsigned mask = old_token_features[i].classes_mask;
+        if (mask) {
+            int idx = params.get_or_add_feature(old_tokens[i]);
+            params.token_features[idx].classes_mask = mask;
         }
     }
 }
 
 sbd_model sbd_model::train_model(const string &sbd_text_path,
-                                 const string &word_classes_path) {
+                                 const string &word_classes_path,
+                                 const sbd_train_options &options,
+                                 sbd_train_stats *stats) {
     sbd_model rez;
     model_params &params = rez.data->params;
+    params.set_hash_bits(options.hash_bits);
     load_word_classes(params, word_classes_path);
-    train_params(params, sbd_text_path);
+    train_params(params, sbd_text_path, options, 0, stats);
 
     return move(rez);
 }
 
+sbd_model sbd_model::train_model(const string &sbd_text_path,
+                                 const sbd_model &initial_model,
+                                 const sbd_train_options &options,
+                                 sbd_train_stats *stats) {
+    check_warm_start_options(options);
+    if (options.out_of_core) {
+        check_out_of_core_options(options);
+    }
+    const model_params &initial = initial_model.data->params;
+    sbd_model rez;
+    model_params &params = rez.data->params;
+    // Same token indices as the initial model, so that its weights line up
+    // with the new samples.
+    copy_vocabulary(initial, params);
+    vector<float> initial_weights = get_weights(initial);
+    train_params(params, sbd_text_path, options, &initial_weights, stats);
+
+    return move(rez);
+}
+
+sbd_model sbd_model::train_model_from_cache(
+        const string &sample_cache_path,
+        const sbd_train_options &options,
+        sbd_train_stats *stats) {
+    if (options.out_of_core) {
+        check_out_of_core_options(options);
+    }
+    sbd_model rez;
+    model_params &params = rez.data->params;
+    sample_cache_reader cache(sample_cache_path);
+    cache.read_params(params);
+    train_from_cache(params, cache, options, 0, stats);
+
+    return move(rez);
+}
+
+class sbd_training_set::private_data {
+public:
+    model_params params;
+    vector<string> lines;
+    vector<pair<unsigned, unsigned>> fold_lines;
+    // Index of the first sample of every fold, followed by the number of
+    // samples.
+    vector<unsigned> fold_samples;
+    vector<sample_type> samples;
+    vector<double> labels;
+    vector<int> counts;
+};
+
+sbd_training_set::sbd_training_set(const string &sbd_text_path,
+                                   const string &word_classes_path,
+                                   int n_folds,
+                                   const sbd_train_options &options) :
+    data(new private_data) {
+    if (n_folds < 2) {
+        throw runtime_error("Cross-validation needs at least two folds.");
+    }
+    model_params &params = data->params;
+    const vector<string> &lines = data->lines;
+    params.set_hash_bits(options.hash_bits);
+    load_word_classes(params, word_classes_path);
+    data->lines = read_lines(sbd_text_path);
+    if (lines.size() < static_cast<unsigned>(n_folds)) {
+        throw runtime_error("Too few lines for cross-validation.");
+    }
+    params.set_eos_chars(collect_eos_chars(
+                lines, options.eos_char_min_frequency));
+
+    // Every fold is split further so that all threads are busy.
+    data->fold_lines = split_lines(lines, 0, lines.size(), n_folds);
+    int shards_per_fold = max(1, (options.n_threads + n_folds - 1) / n_folds);
+    vector<pair<unsigned, unsigned>> ranges;
+    for (int fold = 0; fold < n_folds; ++fold) {
+        vector<pair<unsigned, unsigned>> fold_ranges = split_lines(
+                lines, data->fold_lines[fold].first,
+                data->fold_lines[fold].second, shards_per_fold);
+        ranges.insert(ranges.end(), fold_ranges.begin(), fold_ranges.end());
+    }
+    // Samples are filtered and deduplicated per training run.
+    sbd_train_options extract_options(options);
+    extract_options.deduplicate_samples = false;
+    vector<unsigned> shard_starts;
+    generate_features_parallel(params, lines, ranges, extract_options, 0,
+                               &data->samples, &data->labels, &data->counts,
+                               &shard_starts);
+    for (int fold = 0; fold < n_folds; ++fold) {
+        data->fold_samples.push_back(shard_starts[fold * shards_per_fold]);
+    }
+    data->fold_samples.push_back(data->samples.size());
+}
+
+int sbd_training_set::n_folds() const {
+    return data->fold_lines.size();
+}
+
+sbd_eval_result sbd_training_set::cross_validate(
+        int fold, const sbd_train_options &options) const {
+    const private_data &d = *data;
+    unsigned first_sample = d.fold_samples[fold];
+    unsigned last_sample = d.fold_samples[fold + 1];
+
+    vector<sample_type> samples(d.samples.begin(),
+                                d.samples.begin() + first_sample);
+    samples.insert(samples.end(), d.samples.begin() + last_sample,
+                   d.samples.end());
+    vector<double> labels(d.labels.begin(), d.labels.begin() + first_sample);
+    labels.insert(labels.end(), d.labels.begin() + last_sample,
+                  d.labels.end());
+    vector<int> counts(d.counts.begin(), d.counts.begin() + first_sample);
+    counts.insert(counts.end(), d.counts.begin() + last_sample,
+                  d.counts.end());
+
+    model_params params;
+    copy_vocabulary(d.params, params);
+    sbd_train_stats stats;
+    train_samples(params, samples, labels, counts, options, 0, &stats);
+    vector<sample_type>().swap(samples);
+
+    sbd_eval_result rez;
+    rez.tp = rez.fp = rez.fn = 0;
+    vector<float> w = get_weights(params);
+    rez.n_weights = w.size() - count(w.begin(), w.end(), 0.f);
+    rez.train_seconds = stats.train_seconds;
+
+    // Classifies the sentence end candidates of the held out lines, found
+    // the same way as for training. This scores the model's decision at
+    // each candidate; it does not run text_sentences over the text.
+    const pair<unsigned, unsigned> &range = d.fold_lines[fold];
+    size_t n_bytes = 0;
+    for (unsigned i = range.first; i < range.second; ++i) {
+        n_bytes += d.lines[i].size() + 1;
+    }
+    auto eval_start = chrono::steady_clock::now();
+    for_each_candidate(params, d.lines, range.first, range.second,
+                       [&](const sbd_context &context, double label) {
+        bool predicted = params.is_eos(context);
+        bool actual = label > 0;
+        rez.tp += predicted && actual;
+        rez.fp += predicted && !actual;
+        rez.fn += !predicted && actual;
+    });
+    double eval_seconds = chrono::duration<double>(
+            chrono::steady_clock::now() - eval_start).count();
+    rez.bytes_per_second = eval_seconds > 0 ? n_bytes / eval_seconds : 0;
+    return rez;
+}
+
 void sbd_model::save(const std::string &path) const {
     ofstream ofs(path);
     const model_params &params = data->params;
@@ -750,9 +2456,14 @@ void sbd_model::save(const std::string &path) const {
     for (unsigned i = 0; i < params.word_class_features.size(); ++i) {
         for (int j = 0; j < sbd_context::context_size; ++j) {
             ofs << params.word_class_features[i][j]
-                << (j == 2 ? '\n' : ' ');
+                << (j + 1 == sbd_context::context_size ? '\n' : ' ');
         }
     }
+    // Hashed models store bucket indices instead of tokens.
+    bool hashed = params.get_hash_bits() != 0;
+    if (hashed) {
+        ofs << "hashed " << params.get_hash_bits() << '\n';
+    }
     vector<unsigned> nonzero_tokens;
     for (unsigned i = 0; i < params.token_features.size(); ++i) {
         if (accumulate(params.token_features[i].features.begin(),
@@ -763,7 +2474,11 @@ void sbd_model::save(const std::string &path) const {
     ofs << nonzero_tokens.size() << '\n';
     for (unsigned idx = 0; idx < nonzero_tokens.size(); ++idx) {
         unsigned i = nonzero_tokens[idx];
-        ofs << params.token_features[i].token;
+        if (hashed) {
+            ofs << i;
+        } else {
+            ofs << params.tokens[i];
+        }
         for (int j = 0; j < sbd_context::context_size; ++j) {
             ofs << ' ' << params.token_features[i].features[j];
         }
@@ -780,13 +2495,31 @@ void sbd_model::save(const std::string &path) const {
             break;
         }
         for (unsigned i = 0; i < token_list.size(); ++i) {
-            ofs << params.token_features[token_list[i]].token
-                << (i + 1 == token_list.size() ? '\n' : ' ');
+            if (hashed) {
+                ofs << token_list[i];
+            } else {
+                ofs << params.tokens[token_list[i]];
+            }
+            ofs << (i + 1 == token_list.size() ? '\n' : ' ');
         }
     }
 }
 
+static int feature_from_model_file(model_params &params,
+                                   const string &token) {
+    if (!params.get_hash_bits()) {
+        return params.get_or_add_feature(token);
+    }
+    unsigned idx;
+    if (!(istringstream(token) >> idx) ||
+        idx >= params.token_features.size()) {
+        throw runtime_error("Invalid hashed token feature.");
+    }
+    return idx;
+}
+
 sbd_model sbd_model::load(const std::string &path) {
+    LIBSENTENCES_TRACE_TIMER_START(model__load, load_start);
     sbd_model model;
     model_params &params = model.data->params;
 
@@ -835,8 +2568,21 @@ sbd_model sbd_model::load(const std::string &path) {
         }
     }
     {
+        string tmp;
+        if (!(ifs >> tmp)) {
+            throw runtime_error("Expected token features.");
+        }
+        if (tmp == "hashed") {
+            unsigned hash_bits;
+            if (!(ifs >> hash_bits) || !hash_bits ||
+                hash_bits > sbd_train_options::max_hash_bits ||
+                !(ifs >> tmp)) {
+                throw runtime_error("Invalid hashed token features.");
+            }
+            params.set_hash_bits(hash_bits);
+        }
         unsigned n;
-        if (!(ifs >> n)) {
+        if (!(istringstream(tmp) >> n)) {
             throw runtime_error("Expected token features.");
         }
         string token;
@@ -844,7 +2590,7 @@ sbd_model sbd_model::load(const std::string &path) {
             if (!(ifs >> token)) {
                 throw runtime_error("Expected token feature.");
             }
-            int idx = params.get_or_add_feature(token);
+            int idx = feature_from_model_file(params, token);
             for (int j = 0; j < sbd_context::context_size; ++j) {
                 if (!(ifs >> params.token_features[idx].features[j])) {
                     throw runtime_error("Expected token feature.");
@@ -864,10 +2610,13 @@ sbd_model sbd_model::load(const std::string &path) {
         }
         istringstream iss(line);
         while (iss >> token) {
-            int idx = params.get_or_add_feature(token);
+            int idx = feature_from_model_file(params, token);
             params.token_features[idx].classes_mask |= 1 << bit;
         }
     }
+    LIBSENTENCES_TRACE3(model__load, path.c_str(),
+                        LIBSENTENCES_TRACE_ELAPSED(load_start),
+                        params.token_features.size());
     return move(model);
 }
 
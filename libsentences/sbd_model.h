@@ -39,6 +39,144 @@ either expressed or implied, of Frane Saric.
 namespace libsentences {
 
 class sbd_context;
+struct splitter_stats;
+
+enum class sbd_optimizer {
+    sgd,
+    dual_coordinate_descent
+};
+
+struct sbd_train_options {
+    sbd_train_options();
+
+    // Number of threads used for feature extraction. The training corpus is
+    // split into this many shards at line boundaries.
+    int n_threads;
+
+    sbd_optimizer optimizer;
+
+    // Initial SGD learning rate.
+    double learning_rate;
+
+    // L2 regularization strength (lambda) of SGD.
+    double regularization;
+
+    // Cost of a hinge loss unit relative to the L2 regularization for dual
+    // coordinate descent (liblinear's -c).
+    double dual_cd_cost;
+
+    // Number of threads running lock-free parallel SGD. Unlike feature
+    // extraction, the result depends on thread scheduling. Must be 1 with
+    // dual coordinate descent.
+    int n_train_threads;
+
+    // Maximum number of passes over the training samples. Dual coordinate
+    // descent also stops once it has converged.
+    int n_epochs;
+
+    // Seeds the shuffling of the samples and the validation split. Single
+    // threaded training is reproducible for a given seed.
+    unsigned seed;
+
+    // Fraction of the samples held out to evaluate F1 after each epoch.
+    // Zero disables early stopping.
+    double validation_fraction;
+
+    // Training stops after early_stopping_patience epochs in which the
+    // validation F1 didn't improve by more than early_stopping_tolerance.
+    double early_stopping_tolerance;
+    int early_stopping_patience;
+
+    // Characters ending fewer training lines than this aren't considered
+    // sentence endings.
+    int eos_char_min_frequency;
+
+    // When nonzero, token features are hashed into 2^hash_bits buckets
+    // instead of being looked up in a vocabulary. The model then has a fixed
+    // size and doesn't store any tokens. A bucket takes 40 bytes, so at
+    // max_hash_bits the model needs 640 MB and training about twice that.
+    unsigned hash_bits;
+    static const unsigned max_hash_bits = 24;
+
+    // Token features occurring fewer times than this are dropped.
+    int min_feature_frequency;
+
+    // When nonzero, a first pass estimates token frequencies with a
+    // count-min sketch of 4 x 2^vocabulary_sketch_bits counters, and tokens
+    // that can't reach min_feature_frequency aren't added to the vocabulary.
+    // The trained weights are the same (only the order of tokens in the saved
+    // model may differ), but the long tail of tokens takes no memory. The
+    // training lines themselves are still all kept in memory.
+    unsigned vocabulary_sketch_bits;
+
+    // Collapses identical samples into one sample with a count, which is
+    // used to weight its updates.
+    bool deduplicate_samples;
+
+    // When not empty, the extracted samples are also written to this binary
+    // cache file, which train_model_from_cache can train on later.
+    std::string sample_cache_path;
+
+    // Streams the samples from the sample cache in chunks during every epoch
+    // instead of keeping all of them in memory. When training from text,
+    // the samples are also written to the cache a chunk at a time (the
+    // training lines are still read into memory). Needs a sample cache and
+    // only supports single threaded SGD without validation or
+    // deduplication.
+    bool out_of_core;
+
+    // When warm starting, regularize toward the initial model's weights
+    // instead of zero, this many times more strongly than usual. Zero just
+    // continues training from the initial weights.
+    double prior_regularization;
+
+    // Replaces learning_rate when warm starting. The model doesn't record
+    // how far its SGD schedule got, and restarting at the full learning
+    // rate would let the first updates overwrite the initial weights.
+    double warm_start_learning_rate;
+};
+
+inline sbd_train_options::sbd_train_options() :
+    n_threads(1), optimizer(sbd_optimizer::sgd), learning_rate(1),
+    regularization(1e-4), dual_cd_cost(1),
+    n_train_threads(1),
+    n_epochs(100), seed(1),
+    validation_fraction(0), early_stopping_tolerance(1e-4),
+    early_stopping_patience(3), eos_char_min_frequency(2), hash_bits(0),
+    min_feature_frequency(5), vocabulary_sketch_bits(0),
+    deduplicate_samples(false), out_of_core(false),
+    prior_regularization(0), warm_start_learning_rate(0.01) {
+}
+
+struct sbd_train_stats {
+    // Size of the token vocabulary (or hash table) during training.
+    int n_tokens;
+    int n_samples;
+    int n_unique_samples;
+    int n_epochs;
+    // Best F1 on the held out samples, -1 without early stopping.
+    double validation_f1;
+    double train_seconds;
+    // Estimated time the remaining epochs would have taken.
+    double seconds_saved;
+};
+
+struct sbd_eval_result {
+    double f1() const;
+
+    int tp;
+    int fp;
+    int fn;
+    // Nonzero weights of the trained model.
+    int n_weights;
+    double train_seconds;
+    // Held out text split per second, including tokenization.
+    double bytes_per_second;
+};
+
+inline double sbd_eval_result::f1() const {
+    return tp ? 2. * tp / (2 * tp + fp + fn) : 0.;
+}
 
 class sbd_model {
     class private_data;
@@ -46,12 +184,57 @@ public:
     sbd_model();
 
     bool is_eos(const sbd_context &context) const;
+    // Same as is_eos, but also counts into stats (if not null) when the
+    // library is built with LIBSENTENCES_STATS.
+    bool is_eos(const sbd_context &context, splitter_stats *stats) const;
 
     static sbd_model load(const std::string &path);
     void save(const std::string &path) const;
 
-    static sbd_model train_model(const std::string &sbd_text_path,
-                                 const std::string &word_classes_path);
+    static sbd_model train_model(
+            const std::string &sbd_text_path,
+            const std::string &word_classes_path,
+            const sbd_train_options &options = sbd_train_options(),
+            sbd_train_stats *stats = 0);
+    // Continues training initial_model on new text. The initial model's eos
+    // chars, word classes and vocabulary are kept and new tokens are added.
+    // Only single threaded SGD is supported.
+    static sbd_model train_model(
+            const std::string &sbd_text_path,
+            const sbd_model &initial_model,
+            const sbd_train_options &options = sbd_train_options(),
+            sbd_train_stats *stats = 0);
+    // Trains on samples written by train_model with
+    // sbd_train_options::sample_cache_path. Feature extraction options
+    // don't apply.
+    static sbd_model train_model_from_cache(
+            const std::string &sample_cache_path,
+            const sbd_train_options &options = sbd_train_options(),
+            sbd_train_stats *stats = 0);
+private:
+    friend class sbd_model_inspector;
+
+    std::shared_ptr<private_data> data;
+};
+
+// Samples extracted once from a training corpus, split into folds of
+// consecutive lines, for cross-validating training options in memory.
+class sbd_training_set {
+    class private_data;
+public:
+    // Uses the extraction options (threads, eos chars, hashing) of options.
+    sbd_training_set(const std::string &sbd_text_path,
+                     const std::string &word_classes_path,
+                     int n_folds,
+                     const sbd_train_options &options = sbd_train_options());
+
+    int n_folds() const;
+
+    // Trains on all folds except the given one and evaluates the model on
+    // it. Can be called from several threads at once; each call holds its
+    // own copy of the training samples.
+    sbd_eval_result cross_validate(int fold,
+                                   const sbd_train_options &options) const;
 private:
     std::shared_ptr<private_data> data;
 };
@@ -0,0 +1,178 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#include <libsentences/sentenced_client.h>
+
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+using namespace std;
+
+namespace libsentences {
+
+namespace sentenced_protocol {
+
+void put_uint32(uint32_t x, string *out) {
+    for (int i = 0; i < 4; ++i) {
+        *out += char(x >> (8 * i));
+    }
+}
+
+void put_uint64(uint64_t x, string *out) {
+    for (int i = 0; i < 8; ++i) {
+        *out += char(x >> (8 * i));
+    }
+}
+
+uint32_t get_uint32(const char *p) {
+    uint32_t x = 0;
+    for (int i = 3; i >= 0; --i) {
+        x = x << 8 | (unsigned char)p[i];
+    }
+    return x;
+}
+
+uint64_t get_uint64(const char *p) {
+    uint64_t x = 0;
+    for (int i = 7; i >= 0; --i) {
+        x = x << 8 | (unsigned char)p[i];
+    }
+    return x;
+}
+
+bool read_exactly(int fd, char *p, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, p + done, len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw runtime_error(string("Read failed: ") + strerror(errno));
+        }
+        if (n == 0) {
+            if (done == 0) {
+                return false;
+            }
+            throw runtime_error("Connection closed in the middle of a "
+                                "message.");
+        }
+        done += n;
+    }
+    return true;
+}
+
+void write_exactly(int fd, const char *p, size_t len) {
+    while (len) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw runtime_error(string("Write failed: ") + strerror(errno));
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+}
+
+using namespace sentenced_protocol;
+
+sentenced_client::sentenced_client(const string &socket_path) :
+    fd(socket(AF_UNIX, SOCK_STREAM, 0)) {
+    if (fd == -1) {
+        throw runtime_error(string("Can't create socket: ") +
+                            strerror(errno));
+    }
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        close(fd);
+        throw runtime_error("Socket path too long: " + socket_path);
+    }
+    strcpy(addr.sun_path, socket_path.c_str());
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+        int error = errno;
+        close(fd);
+        throw runtime_error("Can't connect to " + socket_path + ": " +
+                            strerror(error));
+    }
+}
+
+sentenced_client::~sentenced_client() {
+    close(fd);
+}
+
+vector<sentence_span> sentenced_client::split(const utf8_slice &text,
+                                              unsigned model_index) {
+    header.clear();
+    put_uint32(model_index, &header);
+    put_uint64(text.size(), &header);
+    write_exactly(fd, header.data(), header.size());
+    write_exactly(fd, text.ptr(), text.size());
+
+    char buf[12];
+    if (!read_exactly(fd, buf, sizeof(buf))) {
+        throw runtime_error("sentenced closed the connection.");
+    }
+    uint32_t status = get_uint32(buf);
+    uint64_t n = get_uint64(buf + 4);
+    if (status != ok) {
+        string message(n, '\0');
+        if (n && !read_exactly(fd, &message[0], n)) {
+            throw runtime_error("sentenced closed the connection.");
+        }
+        throw runtime_error("sentenced: " + message);
+    }
+    reply.resize(16 * n);
+    if (n && !read_exactly(fd, &reply[0], reply.size())) {
+        throw runtime_error("sentenced closed the connection.");
+    }
+    vector<sentence_span> spans(n);
+    for (uint64_t i = 0; i < n; ++i) {
+        spans[i].offset = get_uint64(&reply[16 * i]);
+        spans[i].length = get_uint64(&reply[16 * i + 8]);
+    }
+    return spans;
+}
+
+}
@@ -0,0 +1,100 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#ifndef LIBSENTENCES__SENTENCED_CLIENT_H
+#define LIBSENTENCES__SENTENCED_CLIENT_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <libsentences/utf8_slice.h>
+
+namespace libsentences {
+
+// Protocol of the sentenced daemon over a Unix domain socket. All integers
+// are little-endian. A connection carries any number of requests, each
+// answered before the next one is read:
+//
+//   request: uint32 model index, uint64 length, the document
+//   reply:   uint32 status, then if it is ok a uint64 count and count
+//            pairs of uint64 offset and length of the sentences, otherwise
+//            a uint64 length and an error message.
+namespace sentenced_protocol {
+
+enum status : uint32_t {
+    ok = 0,
+    bad_model = 1,
+    document_too_large = 2,
+    internal_error = 3
+};
+
+const size_t request_header_size = 12;
+
+void put_uint32(uint32_t x, std::string *out);
+void put_uint64(uint64_t x, std::string *out);
+uint32_t get_uint32(const char *p);
+uint64_t get_uint64(const char *p);
+
+// Return false if the peer closed the connection before the first byte.
+// Other errors and short reads throw runtime_error.
+bool read_exactly(int fd, char *p, size_t len);
+void write_exactly(int fd, const char *p, size_t len);
+
+}
+
+struct sentence_span {
+    uint64_t offset;
+    uint64_t length;
+};
+
+// Connection to a sentenced daemon. Not thread safe; use one client per
+// thread.
+class sentenced_client {
+public:
+    explicit sentenced_client(const std::string &socket_path);
+    sentenced_client(const sentenced_client &) = delete;
+    sentenced_client &operator=(const sentenced_client &) = delete;
+    ~sentenced_client();
+
+    // Splits text with the daemon's model_index-th model. Throws
+    // runtime_error with the daemon's message if it fails.
+    std::vector<sentence_span> split(const utf8_slice &text,
+                                     unsigned model_index = 0);
+private:
+    int fd;
+    std::string header;
+    std::string reply;
+};
+
+}
+
+#endif
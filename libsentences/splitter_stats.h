@@ -0,0 +1,153 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#ifndef LIBSENTENCES__SPLITTER_STATS_H
+#define LIBSENTENCES__SPLITTER_STATS_H
+
+#include <cstdint>
+#include <chrono>
+
+#if defined(LIBSENTENCES_STATS_TIMING) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+namespace libsentences {
+
+// Counters collected while splitting text. They are only updated when the
+// library is built with LIBSENTENCES_STATS (and the phase timers with
+// LIBSENTENCES_STATS_TIMING); otherwise the counting code compiles away and
+// everything stays zero.
+struct splitter_stats {
+    splitter_stats();
+
+    // Whether the library was built with LIBSENTENCES_STATS (and
+    // LIBSENTENCES_STATS_TIMING). Defined in the library, so they don't
+    // depend on the macros of the caller.
+    static bool enabled();
+    static bool timing_enabled();
+
+    // Adds the counters of b, e.g. to sum the stats of several threads.
+    splitter_stats &operator+=(const splitter_stats &b);
+    // Subtracts the counters of b, an earlier snapshot of the same stats.
+    splitter_stats &operator-=(const splitter_stats &b);
+
+    uint64_t tokens;
+    // Bytes of the documents split to the end, added up over documents.
+    uint64_t bytes;
+    uint64_t sentences;
+    // Tokens checked by is_eos_candidate, and how many of them were
+    // candidates and had the model evaluated.
+    uint64_t eos_candidate_checks;
+    uint64_t model_evaluations;
+    // token_to_idx lookups of non-empty context tokens during evaluation.
+    uint64_t vocabulary_hits;
+    uint64_t vocabulary_misses;
+    uint64_t quote_activations;
+    // Quotes that didn't close in time, so the tokens were scanned again.
+    uint64_t quote_rewinds;
+    // Breaks forced by newlines (sbd_eol_handling).
+    uint64_t eol_breaks;
+    // Time stamp counter ticks (nanoseconds without rdtsc) spent
+    // tokenizing and in the model.
+    uint64_t tokenize_ticks;
+    uint64_t classify_ticks;
+};
+
+inline splitter_stats::splitter_stats() :
+    tokens(0), bytes(0), sentences(0), eos_candidate_checks(0),
+    model_evaluations(0), vocabulary_hits(0), vocabulary_misses(0),
+    quote_activations(0), quote_rewinds(0), eol_breaks(0),
+    tokenize_ticks(0), classify_ticks(0) {
+}
+
+inline splitter_stats &splitter_stats::operator+=(const splitter_stats &b) {
+    tokens += b.tokens;
+    bytes += b.bytes;
+    sentences += b.sentences;
+    eos_candidate_checks += b.eos_candidate_checks;
+    model_evaluations += b.model_evaluations;
+    vocabulary_hits += b.vocabulary_hits;
+    vocabulary_misses += b.vocabulary_misses;
+    quote_activations += b.quote_activations;
+    quote_rewinds += b.quote_rewinds;
+    eol_breaks += b.eol_breaks;
+    tokenize_ticks += b.tokenize_ticks;
+    classify_ticks += b.classify_ticks;
+    return *this;
+}
+
+inline splitter_stats &splitter_stats::operator-=(const splitter_stats &b) {
+    tokens -= b.tokens;
+    bytes -= b.bytes;
+    sentences -= b.sentences;
+    eos_candidate_checks -= b.eos_candidate_checks;
+    model_evaluations -= b.model_evaluations;
+    vocabulary_hits -= b.vocabulary_hits;
+    vocabulary_misses -= b.vocabulary_misses;
+    quote_activations -= b.quote_activations;
+    quote_rewinds -= b.quote_rewinds;
+    eol_breaks -= b.eol_breaks;
+    tokenize_ticks -= b.tokenize_ticks;
+    classify_ticks -= b.classify_ticks;
+    return *this;
+}
+
+inline uint64_t splitter_ticks() {
+#if defined(LIBSENTENCES_STATS_TIMING) && \
+    (defined(__x86_64__) || defined(__i386__))
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+}
+
+#ifdef LIBSENTENCES_STATS
+#define LIBSENTENCES_STAT_ADD(stats, counter, n) \
+    do { if (stats) { (stats)->counter += (n); } } while (0)
+#else
+#define LIBSENTENCES_STAT_ADD(stats, counter, n) do { } while (0)
+#endif
+
+#if defined(LIBSENTENCES_STATS) && defined(LIBSENTENCES_STATS_TIMING)
+#define LIBSENTENCES_TIMER_START(timer) \
+    uint64_t timer = libsentences::splitter_ticks()
+#define LIBSENTENCES_TIMER_ADD(stats, counter, timer) \
+    LIBSENTENCES_STAT_ADD(stats, counter, \
+                          libsentences::splitter_ticks() - timer)
+#else
+#define LIBSENTENCES_TIMER_START(timer) do { } while (0)
+#define LIBSENTENCES_TIMER_ADD(stats, counter, timer) do { } while (0)
+#endif
+
+#endif
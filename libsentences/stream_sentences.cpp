@@ -0,0 +1,198 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#include <libsentences/stream_sentences.h>
+#include <libsentences/quotes_detector.h>
+#include <libsentences/splitter_stats.h>
+
+#include <algorithm>
+
+using namespace std;
+
+namespace libsentences {
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' ||
+           c == '\v';
+}
+
+// Start of the n-th whitespace separated word ending before pos, or 0 if
+// there are fewer words. Every word holds at least one token.
+static size_t nth_word_before(const string &s, size_t pos, int n) {
+    while (n-- > 0) {
+        while (pos > 0 && is_space(s[pos - 1])) {
+            --pos;
+        }
+        if (pos == 0) {
+            return 0;
+        }
+        while (pos > 0 && !is_space(s[pos - 1])) {
+            --pos;
+        }
+    }
+    return pos;
+}
+
+stream_sentences::stream_sentences(const sbd_model &model_,
+                                   sbd_eol_handling eh_,
+                                   const quotes_detector *qd_,
+                                   splitter_stats *stats_) :
+    model(model_), eh(eh_), qd(qd_), stats(stats_),
+    // The last word may still be incomplete, and a quote can make the
+    // splitter look ahead max_token_dist tokens.
+    lookahead_words(sbd_context::context_right + 2 +
+                    (qd ? qd->max_token_dist() : 0)),
+    left_context_words(sbd_context::context_left + 2),
+    dropped(0), emitted(0), unsplit(0), drop_pending(0) {
+}
+
+void stream_sentences::compact() {
+    buffer.erase(0, drop_pending);
+    dropped += drop_pending;
+    emitted -= drop_pending;
+    drop_pending = 0;
+}
+
+void stream_sentences::write(const char *p, size_t len,
+                             const sentence_callback &f) {
+    compact();
+    buffer.append(p, len);
+    unsplit += len;
+    if (unsplit >= min_split_bytes) {
+        split(false, f);
+    }
+}
+
+void stream_sentences::finish(const sentence_callback &f) {
+    compact();
+    split(true, f);
+    emitted = buffer.size();
+    drop_pending = buffer.size();
+}
+
+void stream_sentences::force_break(size_t first,
+                                   const sentence_callback &f) {
+    // Cut after the last word that fits, or else between two UTF-8
+    // sequences.
+    size_t last = first + max_sentence_bytes;
+    size_t cut = last;
+    if (!is_space(buffer[cut])) {
+        while (cut > first && !is_space(buffer[cut - 1])) {
+            --cut;
+        }
+    }
+    while (cut > first && is_space(buffer[cut - 1])) {
+        --cut;
+    }
+    if (cut == first) {
+        cut = last;
+        while (cut > first && (buffer[cut] & 0xC0) == 0x80) {
+            --cut;
+        }
+    }
+    const char *base = buffer.data();
+    f(utf8_slice(base + first, base + cut));
+    LIBSENTENCES_STAT_ADD(stats, sentences, 1);
+    emitted = cut;
+}
+
+void stream_sentences::cut_long_text(size_t end,
+                                     const sentence_callback &f) {
+    for (;;) {
+        size_t first = emitted;
+        while (first < end && is_space(buffer[first])) {
+            ++first;
+        }
+        if (end - first <= max_sentence_bytes) {
+            return;
+        }
+        force_break(first, f);
+    }
+}
+
+void stream_sentences::split(bool final, const sentence_callback &f) {
+    unsplit = 0;
+    // Sentences ending after limit could still change with more text.
+    size_t limit = final ? buffer.size() :
+        nth_word_before(buffer, buffer.size(), lookahead_words);
+    // Very long words would make the lookahead unbounded.
+    if (buffer.size() - limit > max_sentence_bytes) {
+        limit = buffer.size() - max_sentence_bytes;
+    }
+    if (limit <= emitted) {
+        return;
+    }
+    // Decisions only depend on a few tokens around them, so splitting from
+    // a few words before the last sentence end finds the same end again.
+    // Anything ending before it was already passed on.
+    size_t start = nth_word_before(buffer, emitted, left_context_words);
+    size_t first_emitted = emitted;
+    const char *base = buffer.data();
+    // The left context and the text after limit are split again by the
+    // next split, so only the counts between the last sentence that was
+    // already passed on and the last one passed on now are kept.
+    splitter_stats split_stats, skipped, passed_on;
+    text_sentences ts(utf8_slice(base + start, base + buffer.size()),
+                      model, eh, qd, stats ? &split_stats : 0);
+    for (text_sentences::iterator i = ts.begin(), e = ts.end();
+         i != e; ++i) {
+        utf8_slice sentence = *i;
+        size_t end = sentence.ptr() + sentence.size() - base;
+        if (end <= emitted) {
+            skipped = passed_on = split_stats;
+            continue;
+        }
+        if (end > limit) {
+            break;
+        }
+        cut_long_text(end, f);
+        // After a forced break the splitter finds no end at emitted.
+        const char *first = max(sentence.ptr(), base + emitted);
+        while (is_space(*first)) {
+            ++first;
+        }
+        f(utf8_slice(first, sentence.ptr() + sentence.size()));
+        emitted = end;
+        passed_on = split_stats;
+    }
+    cut_long_text(limit, f);
+    if (stats) {
+        passed_on -= skipped;
+        // Bytes are those of the text passed on, and of the whitespace
+        // after the last sentence once the stream ends.
+        passed_on.bytes = (final ? buffer.size() : emitted) - first_emitted;
+        *stats += passed_on;
+    }
+    if (!final) {
+        drop_pending = nth_word_before(buffer, emitted, left_context_words);
+    }
+}
+
+}
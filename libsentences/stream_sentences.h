@@ -0,0 +1,120 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#ifndef LIBSENTENCES__STREAM_SENTENCES_H
+#define LIBSENTENCES__STREAM_SENTENCES_H
+
+#include <string>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+#include <libsentences/text_sentences.h>
+
+namespace libsentences {
+
+// Splits text that arrives in chunks, for input that doesn't fit in memory.
+// Sentences are passed on as soon as the text after them can't change where
+// they end, and only the unfinished tail (with the context needed to split
+// it) is kept. The result is the same as splitting the whole text with
+// text_sentences, except that text going on for more than
+// max_sentence_bytes without a sentence end is cut, which bounds the memory
+// used.
+// The stats only count the text passed on, not the context that is split
+// again, so they are close to those of splitting the whole text.
+class stream_sentences {
+public:
+    // Gets each final sentence. The slice (and offset of pointers into it)
+    // stays valid until the next call to write or finish.
+    typedef std::function<void(const utf8_slice &)> sentence_callback;
+
+    stream_sentences(
+        const sbd_model &model,
+        sbd_eol_handling eh = sbd_eol_handling::split_on_multiple_eols,
+        const quotes_detector *qd = 0,
+        splitter_stats *stats = 0);
+
+    // Appends text. The text is split once at least min_split_bytes are
+    // buffered, so larger writes are cheaper.
+    void write(const char *p, size_t len, const sentence_callback &f);
+    // Splits the rest of the text after the last write.
+    void finish(const sentence_callback &f);
+
+    // Bytes currently held.
+    size_t buffered() const;
+    // Offset from the start of the stream of a pointer into a sentence
+    // passed to the callback.
+    uint64_t offset(const char *p) const;
+
+    static const size_t min_split_bytes = 1 << 16;
+    // Longest sentence passed on in one piece; longer ones are cut at the
+    // last whitespace before this many bytes.
+    static const size_t max_sentence_bytes = 1 << 20;
+private:
+    void split(bool final, const sentence_callback &f);
+    // Passes on at most max_sentence_bytes starting at first as a sentence.
+    void force_break(size_t first, const sentence_callback &f);
+    // Forces breaks until the text between emitted and end isn't longer than
+    // max_sentence_bytes, so that text without sentence ends isn't buffered
+    // and rescanned forever.
+    void cut_long_text(size_t end, const sentence_callback &f);
+    // Drops the text before the context of the last sentence passed on,
+    // once the caller is done with the slices.
+    void compact();
+
+    const sbd_model &model;
+    sbd_eol_handling eh;
+    const quotes_detector *qd;
+    splitter_stats *stats;
+    // Words that have to follow a sentence before it is final, and that are
+    // kept before the end of the last sentence as its left context.
+    int lookahead_words;
+    int left_context_words;
+    std::string buffer;
+    // Bytes dropped before the start of buffer.
+    uint64_t dropped;
+    // End of the last sentence passed on.
+    size_t emitted;
+    size_t unsplit;
+    // Bytes at the start of buffer the next write or finish drops.
+    size_t drop_pending;
+};
+
+inline size_t stream_sentences::buffered() const {
+    return buffer.size();
+}
+
+inline uint64_t stream_sentences::offset(const char *p) const {
+    return dropped + (p - buffer.data());
+}
+
+}
+
+#endif
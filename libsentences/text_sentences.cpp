@@ -28,6 +28,7 @@ of the authors and should not be interpreted as representing official policies,
 either expressed or implied, of Frane Saric.
 */
 
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 
@@ -35,6 +36,8 @@ either expressed or implied, of Frane Saric.
 #include <libsentences/sbd_model.h>
 #include <libsentences/quotes_detector.h>
 #include <libsentences/standard_tokenizer.h>
+#include <libsentences/splitter_stats.h>
+#include <libsentences/tracepoints.h>
 
 #include <boost/tokenizer.hpp>
 #include <boost/iterator/iterator_facade.hpp>
@@ -48,19 +51,60 @@ public:
     sentence_iterator_shared_data(const utf8_slice &text_,
                                   const sbd_model &model_,
                                   sbd_eol_handling eh_,
-                                  const quotes_detector *qd_) :
+                                  const quotes_detector *qd_,
+                                  splitter_stats *stats_) :
         text(text_), model(model_), eh(eh_),
-        tokenizer(text), tokens_end(tokenizer.end()), qd(qd_) {
+        tokenizer(text), tokens_end(tokenizer.end()), qd(qd_),
+        stats(stats_), ended(false) {
+#ifdef LIBSENTENCES_TRACEPOINTS
+        LIBSENTENCES_TRACE_TIMER_START(document__end, start);
+        trace_start = start;
+#endif
+        LIBSENTENCES_TRACE2(document__start, text.ptr(), text.size());
     }
 
+    // Counts the bytes of the document and fires document__end when the
+    // end is reached, once per document even if it is iterated several
+    // times.
+    void end_of_document() const;
+
+    // Reads the next token into the context.
+    void add_token(sbd_context &context,
+                   standard_tokenizer::const_iterator &it) const;
+
     utf8_slice text;
     const sbd_model &model;
     sbd_eol_handling eh;
     standard_tokenizer tokenizer;
     standard_tokenizer::const_iterator tokens_end;
     const quotes_detector *qd;
+    splitter_stats *stats;
+    mutable bool ended;
+#ifdef LIBSENTENCES_TRACEPOINTS
+    // When the document was created, if document__end was traced then.
+    uint64_t trace_start;
+#endif
 };
 
+inline void sentence_iterator_shared_data::end_of_document() const {
+    if (ended) {
+        return;
+    }
+    ended = true;
+    LIBSENTENCES_STAT_ADD(stats, bytes, text.size());
+    LIBSENTENCES_TRACE3(document__end, text.ptr(), text.size(),
+                        LIBSENTENCES_TRACE_ELAPSED(trace_start));
+}
+
+inline void sentence_iterator_shared_data::add_token(
+        sbd_context &context, standard_tokenizer::const_iterator &it) const {
+    LIBSENTENCES_TIMER_START(tokenize_start);
+    context.add_token(*it);
+    ++it;
+    LIBSENTENCES_TIMER_ADD(stats, tokenize_ticks, tokenize_start);
+    LIBSENTENCES_STAT_ADD(stats, tokens, 1);
+}
+
 static bool has_newlines_between(const utf8_slice &a, const utf8_slice &b) {
     const char *p = a.ptr() + a.size(), *e = b.ptr();
     while (p < e) {
@@ -119,11 +163,15 @@ void sentence_iterator::increment() {
     sentence_start = 0;
     for (;;) {
         if (cur_token_it != sd->tokens_end) {
-            context.add_token(*cur_token_it);
-            ++cur_token_it;
+            sd->add_token(context, cur_token_it);
         } else {
             if (context.get_token(1).empty()) {
                 if (active_quote) {
+                    LIBSENTENCES_STAT_ADD(sd->stats, quote_rewinds, 1);
+                    LIBSENTENCES_TRACE2(quote__rewind,
+                        quote_start_context.get_token(0).begin().ptr() -
+                        sd->text.ptr(),
+                        sd->text.size());
                     active_quote = 0;
                     cur_token_it = quote_start_it;
                     context = quote_start_context;
@@ -142,6 +190,7 @@ void sentence_iterator::increment() {
             if (!active_quote) {
                 active_quote = sd->qd->find_spec(context.get_token(0));
                 if (active_quote) {
+                    LIBSENTENCES_STAT_ADD(sd->stats, quote_activations, 1);
                     quote_dist = 0;
                     quote_start_it = cur_token_it;
                     quote_start_context = context;
@@ -157,6 +206,11 @@ void sentence_iterator::increment() {
                 } else if (quote_dist > active_quote->max_token_dist ||
                     (cur_char == active_quote->open &&
                      i == context.get_token(0).end())) {
+                    LIBSENTENCES_STAT_ADD(sd->stats, quote_rewinds, 1);
+                    LIBSENTENCES_TRACE2(quote__rewind,
+                        quote_start_context.get_token(0).begin().ptr() -
+                        sd->text.ptr(),
+                        context.get_token(0).end().ptr() - sd->text.ptr());
                     active_quote = 0;
                     cur_token_it = quote_start_it;
                     context = quote_start_context;
@@ -169,13 +223,21 @@ not_a_quote:
         sentence_end = context.get_token(0).end();
 
         if (should_break_on_eos(sd->eh, context)) {
+            LIBSENTENCES_STAT_ADD(sd->stats, eol_breaks, 1);
             context.clear_left_and_current();
             break;
         }
-        if (sd->model.is_eos(context)) {
+        LIBSENTENCES_TIMER_START(classify_start);
+        bool eos = sd->model.is_eos(context, sd->stats);
+        LIBSENTENCES_TIMER_ADD(sd->stats, classify_ticks, classify_start);
+        if (eos) {
             break;
         }
     }
+    LIBSENTENCES_STAT_ADD(sd->stats, sentences, sentence_start.ptr() != 0);
+    if (!sentence_start.ptr()) {
+        sd->end_of_document();
+    }
 }
 
 sentence_iterator::sentence_iterator(
@@ -183,13 +245,13 @@ sentence_iterator::sentence_iterator(
         const standard_tokenizer::const_iterator &start)
     : sd(sd_), cur_token_it(start), sentence_start(0) {
     if (cur_token_it == sd->tokens_end) {
+        sd->end_of_document();
         return;
     }
 
     for (int i = 0; i < sbd_context::context_right; ++i) {
         if (cur_token_it != sd->tokens_end) {
-            context.add_token(*cur_token_it);
-            ++cur_token_it;
+            sd->add_token(context, cur_token_it);
         } else {
             context.add_token(utf8_slice());
         }
@@ -211,8 +273,8 @@ bool sentence_iterator::equal(const sentence_iterator &b) const {
 
 text_sentences::text_sentences(
     const utf8_slice &text, const sbd_model &model,
-    sbd_eol_handling eh, const quotes_detector *qd)
-    : sd(new sentence_iterator_shared_data(text, model, eh, qd)) {
+    sbd_eol_handling eh, const quotes_detector *qd, splitter_stats *stats)
+    : sd(new sentence_iterator_shared_data(text, model, eh, qd, stats)) {
 }
 
 text_sentences::iterator text_sentences::begin() const {
@@ -223,4 +285,32 @@ text_sentences::iterator text_sentences::end() const {
     return sentence_iterator(sd.get());
 }
 
+const utf8_slice &text_sentences::text() const {
+    return sd->text;
+}
+
+owned_sentences::owned_sentences() : data(0), offsets(1, 0) {
+}
+
+owned_sentences::owned_sentences(const text_sentences &ts) :
+    data(0), offsets(1, 0) {
+    assign(ts);
+}
+
+void owned_sentences::assign(const text_sentences &ts) {
+    // Sentences don't overlap, so they fit in the size of the text.
+    buffer.reset();
+    char *out = static_cast<char *>(buffer.allocate(
+                static_cast<size_t>(ts.text().size()) + 1));
+    data = out;
+    offsets.resize(1);
+    size_t len = 0;
+    for (text_sentences::iterator i = ts.begin(), e = ts.end(); i != e;
+         ++i) {
+        memcpy(out + len, i->ptr(), i->size());
+        len += i->size();
+        offsets.push_back(len);
+    }
+}
+
 }
@@ -35,15 +35,18 @@ either expressed or implied, of Frane Saric.
 
 #include <libsentences/standard_tokenizer.h>
 #include <libsentences/sbd_context.h>
+#include <libsentences/memory_pool.h>
 
 #include <boost/iterator/iterator_facade.hpp>
 #include <memory>
+#include <vector>
 
 namespace libsentences {
 
 class sbd_model;
 class quotes_detector;
 class sentence_iterator_shared_data;
+struct splitter_stats;
 
 enum class sbd_eol_handling {
     ignore_eol,
@@ -82,14 +85,52 @@ public:
         const utf8_slice &text,
         const sbd_model &model,
         sbd_eol_handling eh = sbd_eol_handling::split_on_multiple_eols,
-        const quotes_detector *qd = 0);
+        const quotes_detector *qd = 0,
+        splitter_stats *stats = 0);
 
     iterator begin() const;
     iterator end() const;
+
+    const utf8_slice &text() const;
 private:
     std::shared_ptr<sentence_iterator_shared_data> sd;
 };
 
+// Copies of the sentences of a text packed into one buffer, for callers that
+// need them after the text is freed. A document takes one allocation instead
+// of a string per sentence, and none when the object is reused. Like the
+// sentences of text_sentences, the copies start at their first token.
+class owned_sentences {
+public:
+    owned_sentences();
+    explicit owned_sentences(const text_sentences &ts);
+
+    // Replaces the sentences with copies of those of ts.
+    void assign(const text_sentences &ts);
+
+    size_t size() const;
+    bool empty() const;
+    // Valid until the next assign.
+    utf8_slice operator[](size_t i) const;
+private:
+    memory_pool buffer;
+    const char *data;
+    // Sentence i is [offsets[i], offsets[i + 1]) in data.
+    std::vector<size_t> offsets;
+};
+
+inline size_t owned_sentences::size() const {
+    return offsets.size() - 1;
+}
+
+inline bool owned_sentences::empty() const {
+    return offsets.size() == 1;
+}
+
+inline utf8_slice owned_sentences::operator[](size_t i) const {
+    return utf8_slice(data + offsets[i], data + offsets[i + 1]);
+}
+
 }
 
 #endif
@@ -0,0 +1,100 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#ifndef LIBSENTENCES__TRACEPOINTS_H
+#define LIBSENTENCES__TRACEPOINTS_H
+
+// Static probes for perf, bpftrace and SystemTap. When the library is built
+// with LIBSENTENCES_TRACEPOINTS they are USDT probes of the provider
+// "libsentences" (a single nop each until a tracer attaches), otherwise they
+// compile away together with their arguments:
+//
+//   document__start(text, size)
+//   document__end(text, size, nanoseconds)
+//   eos__decision(token_end, margin * 1e6, is_eos)
+//   quote__rewind(quote_offset, offset)
+//   model__load(path, nanoseconds, n_token_features)
+//
+// text and token_end are pointers into the document, so the byte offset of a
+// decision is token_end - text of the enclosing document__start. Offsets are
+// in bytes from the start of the document. The margin is passed as an
+// integer because floating point probe arguments aren't portable.
+//
+// The probes have semaphores, which tracers increment while attached, so
+// the clock is only read for document__end and model__load while they are
+// traced (their nanoseconds are 0 if tracing started midway).
+
+#ifdef LIBSENTENCES_TRACEPOINTS
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#include <chrono>
+#include <cstdint>
+
+// Defined in tracepoints.cpp. They can't be in a namespace, since sdt.h
+// refers to them by their assembler names.
+extern unsigned short libsentences_document__start_semaphore;
+extern unsigned short libsentences_document__end_semaphore;
+extern unsigned short libsentences_eos__decision_semaphore;
+extern unsigned short libsentences_quote__rewind_semaphore;
+extern unsigned short libsentences_model__load_semaphore;
+
+namespace libsentences {
+
+inline uint64_t trace_clock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+#define LIBSENTENCES_TRACE2(name, a, b) \
+    STAP_PROBE2(libsentences, name, a, b)
+#define LIBSENTENCES_TRACE3(name, a, b, c) \
+    STAP_PROBE3(libsentences, name, a, b, c)
+#define LIBSENTENCES_TRACE_ENABLED(name) \
+    __builtin_expect(libsentences_##name##_semaphore != 0, 0)
+// Starts timing for the probe name, if it is traced.
+#define LIBSENTENCES_TRACE_TIMER_START(name, timer) \
+    uint64_t timer = LIBSENTENCES_TRACE_ENABLED(name) ? \
+        libsentences::trace_clock_ns() : 0
+#define LIBSENTENCES_TRACE_ELAPSED(timer) \
+    ((timer) ? libsentences::trace_clock_ns() - (timer) : uint64_t(0))
+
+#else
+
+#define LIBSENTENCES_TRACE2(name, a, b) do { } while (0)
+#define LIBSENTENCES_TRACE3(name, a, b, c) do { } while (0)
+#define LIBSENTENCES_TRACE_ENABLED(name) false
+#define LIBSENTENCES_TRACE_TIMER_START(name, timer) do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,332 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <random>
+
+#include <libsentences/sbd_model.h>
+
+using namespace std;
+using libsentences::sbd_train_options;
+
+static void print_usage(const char *program) {
+    cerr << "Usage: " << program
+         << " [--folds K] [--threads N] [--random N] [--seed S]\n"
+            "    [--lambda L,...] [--epochs N,...] [--min-freq N,...]\n"
+            "    [--eos-min-freq N,...] [--learning-rate ETA,...]\n"
+            "    [--optimizer sgd|dcd,...] [--cost C,...] [--dedup]\n"
+            "    train.txt [word_classes.txt]\n"
+            "Trains and evaluates every combination of the given values on\n"
+            "each fold, N at a time (all cores by default), and prints them\n"
+            "ranked by F1. Features are extracted once per --eos-min-freq.\n"
+            "Every running job holds a copy of the training samples.\n"
+            "Each job shuffles with its own generator seeded from S, the\n"
+            "configuration and the fold, so results don't depend on\n"
+            "scheduling.\n";
+}
+
+static vector<string> split_list(const string &list) {
+    vector<string> rez;
+    istringstream iss(list);
+    for (string item; getline(iss, item, ',');) {
+        if (!item.empty()) {
+            rez.push_back(item);
+        }
+    }
+    if (rez.empty()) {
+        throw runtime_error("Empty list of values.");
+    }
+    return rez;
+}
+
+// One swept parameter: its name, values and how to apply a value.
+struct tune_param {
+    string name;
+    vector<string> values;
+    void (*apply)(sbd_train_options &options, const string &value);
+};
+
+static void apply_lambda(sbd_train_options &options, const string &value) {
+    options.regularization = atof(value.c_str());
+    if (options.regularization <= 0) {
+        throw runtime_error("Invalid lambda.");
+    }
+}
+
+static void apply_epochs(sbd_train_options &options, const string &value) {
+    options.n_epochs = atoi(value.c_str());
+    if (options.n_epochs < 1) {
+        throw runtime_error("Invalid number of epochs.");
+    }
+}
+
+static void apply_min_freq(sbd_train_options &options,
+                           const string &value) {
+    options.min_feature_frequency = atoi(value.c_str());
+    if (options.min_feature_frequency < 1) {
+        throw runtime_error("Invalid minimum frequency.");
+    }
+}
+
+static void apply_eos_min_freq(sbd_train_options &options,
+                               const string &value) {
+    options.eos_char_min_frequency = atoi(value.c_str());
+}
+
+static void apply_learning_rate(sbd_train_options &options,
+                                const string &value) {
+    options.learning_rate = atof(value.c_str());
+    if (options.learning_rate <= 0) {
+        throw runtime_error("Invalid learning rate.");
+    }
+}
+
+static void apply_optimizer(sbd_train_options &options,
+                            const string &value) {
+    if (value == "sgd") {
+        options.optimizer = libsentences::sbd_optimizer::sgd;
+    } else if (value == "dcd") {
+        options.optimizer =
+            libsentences::sbd_optimizer::dual_coordinate_descent;
+    } else {
+        throw runtime_error("Unknown optimizer.");
+    }
+}
+
+static void apply_cost(sbd_train_options &options, const string &value) {
+    options.dual_cd_cost = atof(value.c_str());
+    if (options.dual_cd_cost <= 0) {
+        throw runtime_error("Invalid cost.");
+    }
+}
+
+struct tune_config {
+    // Index into the values of every parameter.
+    vector<int> value_idx;
+    sbd_train_options options;
+    vector<libsentences::sbd_eval_result> folds;
+};
+
+int main(int argc, char **argv) {
+    try {
+        if (argc <= 1 || !strcmp(argv[1], "-h") ||
+            !strcmp(argv[1], "--help")) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        vector<tune_param> params = {
+            {"lambda", {"1e-5", "1e-4", "1e-3"}, apply_lambda},
+            {"epochs", {"100"}, apply_epochs},
+            {"min-freq", {"2", "5", "10"}, apply_min_freq},
+            {"eos-min-freq", {"2"}, apply_eos_min_freq},
+            {"learning-rate", {"1"}, apply_learning_rate},
+            {"optimizer", {"sgd"}, apply_optimizer},
+            {"cost", {"1"}, apply_cost},
+        };
+        int n_folds = 5;
+        int n_threads = max(1u, thread::hardware_concurrency());
+        int n_random = 0;
+        unsigned seed = 1;
+        bool dedup = false;
+        vector<string> files;
+        for (int i = 1; i < argc; ++i) {
+            bool found = false;
+            for (unsigned j = 0; j < params.size(); ++j) {
+                if (argv[i] == "--" + params[j].name && i + 1 < argc) {
+                    params[j].values = split_list(argv[++i]);
+                    found = true;
+                }
+            }
+            if (found) {
+                continue;
+            }
+            if (!strcmp(argv[i], "--folds") && i + 1 < argc) {
+                n_folds = atoi(argv[++i]);
+            } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+                n_threads = atoi(argv[++i]);
+                if (n_threads < 1) {
+                    throw runtime_error("Invalid number of threads.");
+                }
+            } else if (!strcmp(argv[i], "--random") && i + 1 < argc) {
+                n_random = atoi(argv[++i]);
+            } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+                seed = atoi(argv[++i]);
+            } else if (!strcmp(argv[i], "--dedup")) {
+                dedup = true;
+            } else if (argv[i][0] == '-') {
+                cerr << "Unknown option: " << argv[i] << '\n';
+                return 1;
+            } else {
+                files.push_back(argv[i]);
+            }
+        }
+        if (files.size() != 1 && files.size() != 2) {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        // Full grid, optionally subsampled at random.
+        vector<tune_config> configs(1);
+        for (unsigned j = 0; j < params.size(); ++j) {
+            vector<tune_config> expanded;
+            for (unsigned c = 0; c < configs.size(); ++c) {
+                for (unsigned v = 0; v < params[j].values.size(); ++v) {
+                    expanded.push_back(configs[c]);
+                    expanded.back().value_idx.push_back(v);
+                    params[j].apply(expanded.back().options,
+                                    params[j].values[v]);
+                }
+            }
+            configs.swap(expanded);
+        }
+        if (n_random > 0 && static_cast<unsigned>(n_random) < configs.size()) {
+            mt19937 rng(seed);
+            shuffle(configs.begin(), configs.end(), rng);
+            configs.resize(n_random);
+        }
+
+        // Features depend only on the eos chars, so extract once per
+        // eos-min-freq value.
+        map<int, shared_ptr<libsentences::sbd_training_set>> training_sets;
+        for (unsigned c = 0; c < configs.size(); ++c) {
+            sbd_train_options &options = configs[c].options;
+            options.deduplicate_samples = dedup;
+            options.n_threads = n_threads;
+            auto &training_set = training_sets[options.eos_char_min_frequency];
+            if (!training_set) {
+                training_set.reset(new libsentences::sbd_training_set(
+                            files[0], files.size() == 2 ? files[1] : "",
+                            n_folds, options));
+            }
+            configs[c].folds.resize(n_folds);
+        }
+
+        int n_jobs = configs.size() * n_folds;
+        cerr << "Running " << configs.size() << " configurations x "
+             << n_folds << " folds on " << n_threads << " threads\n";
+        atomic<int> next_job(0);
+        vector<thread> threads;
+        vector<string> errors(n_threads);
+        for (int t = 0; t < n_threads; ++t) {
+            threads.emplace_back([&, t]() {
+                try {
+                    for (int job; (job = next_job++) < n_jobs;) {
+                        tune_config &config = configs[job / n_folds];
+                        int fold = job % n_folds;
+                        sbd_train_options options = config.options;
+                        seed_seq job_seed = {seed,
+                                             unsigned(job / n_folds),
+                                             unsigned(fold)};
+                        job_seed.generate(&options.seed, &options.seed + 1);
+                        config.folds[fold] = training_sets[
+                            options.eos_char_min_frequency]->
+                            cross_validate(fold, options);
+                    }
+                } catch (const exception &e) {
+                    errors[t] = e.what();
+                    next_job = n_jobs;
+                }
+            });
+        }
+        for (unsigned t = 0; t < threads.size(); ++t) {
+            threads[t].join();
+        }
+        for (int t = 0; t < n_threads; ++t) {
+            if (!errors[t].empty()) {
+                throw runtime_error(errors[t]);
+            }
+        }
+
+        // Mean and standard deviation of F1 over the folds.
+        vector<pair<double, int>> ranking;
+        vector<double> f1_std(configs.size());
+        for (unsigned c = 0; c < configs.size(); ++c) {
+            double sum = 0, sum_sq = 0;
+            for (int fold = 0; fold < n_folds; ++fold) {
+                double f1 = configs[c].folds[fold].f1();
+                sum += f1;
+                sum_sq += f1 * f1;
+            }
+            double mean = sum / n_folds;
+            f1_std[c] = sqrt(max(0., sum_sq / n_folds - mean * mean));
+            ranking.emplace_back(-mean, c);
+        }
+        sort(ranking.begin(), ranking.end());
+
+        cout << setw(4) << "rank";
+        for (unsigned j = 0; j < params.size(); ++j) {
+            cout << ' ' << setw(max<int>(params[j].name.size(), 6))
+                 << params[j].name;
+        }
+        cout << ' ' << setw(8) << "F1" << ' ' << setw(6) << "+-"
+             << ' ' << setw(9) << "weights" << ' ' << setw(8) << "train s"
+             << ' ' << setw(8) << "MB/s" << '\n';
+        for (unsigned r = 0; r < ranking.size(); ++r) {
+            const tune_config &config = configs[ranking[r].second];
+            double n_weights = 0, train_seconds = 0, bytes_per_second = 0;
+            for (int fold = 0; fold < n_folds; ++fold) {
+                n_weights += config.folds[fold].n_weights;
+                train_seconds += config.folds[fold].train_seconds;
+                bytes_per_second += config.folds[fold].bytes_per_second;
+            }
+            cout << setw(4) << r + 1;
+            for (unsigned j = 0; j < params.size(); ++j) {
+                cout << ' ' << setw(max<int>(params[j].name.size(), 6))
+                     << params[j].values[config.value_idx[j]];
+            }
+            cout << fixed << setprecision(2)
+                 << ' ' << setw(8) << -ranking[r].first * 100
+                 << ' ' << setw(6) << f1_std[ranking[r].second] * 100
+                 << setprecision(0)
+                 << ' ' << setw(9) << n_weights / n_folds
+                 << setprecision(2)
+                 << ' ' << setw(8) << train_seconds / n_folds
+                 << ' ' << setw(8) << bytes_per_second / n_folds / 1e6
+                 << '\n';
+            cout.unsetf(ios_base::floatfield);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << '\n';
+        return 1;
+    }
+}
@@ -30,23 +30,170 @@ either expressed or implied, of Frane Saric.
 
 #include <iostream>
 #include <stdexcept>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
 
 #include <libsentences/sbd_model.h>
 
 using namespace std;
 
+static void print_usage(const char *program) {
+    cerr << "Usage: " << program
+         << " [--threads N] [--optimizer sgd|dcd] [--cost C]\n"
+            "    [--train-threads N] [--epochs N] [--seed S] [--dedup]\n"
+            "    [--hash-bits K] [--min-freq N] [--sketch-bits K]\n"
+            "    [--validation FRACTION [--tolerance T] [--patience N]]\n"
+            "    [--write-cache samples.bin] [--out-of-core]\n"
+            "    [--learning-rate ETA]"
+            " [--init-model model.txt [--prior-reg R]]\n"
+            "    train.txt model_output.txt [word_classes.txt]\n"
+            "   or: " << program << " --from-cache samples.bin [options]"
+            " model_output.txt\n"
+            "With --init-model the learning rate defaults to 0.01 instead of\n"
+            "1, so that training continues from the initial weights.\n";
+}
+
 int main(int argc, char **argv) {
     try {
         if (argc <= 1 || !strcmp(argv[1], "-h") ||
-            !strcmp(argv[1], "--help") || (argc != 3 && argc != 4)) {
-            cerr << "Usage: " << argv[0]
-                 << " train.txt model_output.txt [word_classes.txt]\n";
+            !strcmp(argv[1], "--help")) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        libsentences::sbd_train_options options;
+        vector<string> files;
+        string from_cache;
+        string init_model;
+        for (int i = 1; i < argc; ++i) {
+            if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+                options.n_threads = atoi(argv[++i]);
+                if (options.n_threads < 1) {
+                    throw runtime_error("Invalid number of threads.");
+                }
+            } else if (!strcmp(argv[i], "--optimizer") && i + 1 < argc) {
+                ++i;
+                if (!strcmp(argv[i], "sgd")) {
+                    options.optimizer = libsentences::sbd_optimizer::sgd;
+                } else if (!strcmp(argv[i], "dcd")) {
+                    options.optimizer = libsentences::sbd_optimizer::
+                        dual_coordinate_descent;
+                } else {
+                    throw runtime_error("Unknown optimizer.");
+                }
+            } else if (!strcmp(argv[i], "--cost") && i + 1 < argc) {
+                options.dual_cd_cost = atof(argv[++i]);
+                if (options.dual_cd_cost <= 0) {
+                    throw runtime_error("Invalid cost.");
+                }
+            } else if (!strcmp(argv[i], "--train-threads") && i + 1 < argc) {
+                options.n_train_threads = atoi(argv[++i]);
+                if (options.n_train_threads < 1) {
+                    throw runtime_error("Invalid number of threads.");
+                }
+            } else if (!strcmp(argv[i], "--epochs") && i + 1 < argc) {
+                options.n_epochs = atoi(argv[++i]);
+                if (options.n_epochs < 1) {
+                    throw runtime_error("Invalid number of epochs.");
+                }
+            } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+                options.seed = strtoul(argv[++i], nullptr, 10);
+            } else if (!strcmp(argv[i], "--validation") && i + 1 < argc) {
+                options.validation_fraction = atof(argv[++i]);
+                if (options.validation_fraction < 0 ||
+                    options.validation_fraction >= 1) {
+                    throw runtime_error("Invalid validation fraction.");
+                }
+            } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+                options.early_stopping_tolerance = atof(argv[++i]);
+            } else if (!strcmp(argv[i], "--patience") && i + 1 < argc) {
+                options.early_stopping_patience = atoi(argv[++i]);
+                if (options.early_stopping_patience < 1) {
+                    throw runtime_error("Invalid patience.");
+                }
+            } else if (!strcmp(argv[i], "--hash-bits") && i + 1 < argc) {
+                int hash_bits = atoi(argv[++i]);
+                if (hash_bits < 1 || hash_bits > static_cast<int>(
+                        libsentences::sbd_train_options::max_hash_bits)) {
+                    throw runtime_error("Invalid number of hash bits.");
+                }
+                options.hash_bits = hash_bits;
+            } else if (!strcmp(argv[i], "--min-freq") && i + 1 < argc) {
+                options.min_feature_frequency = atoi(argv[++i]);
+                if (options.min_feature_frequency < 1) {
+                    throw runtime_error("Invalid minimum frequency.");
+                }
+            } else if (!strcmp(argv[i], "--sketch-bits") && i + 1 < argc) {
+                int sketch_bits = atoi(argv[++i]);
+                if (sketch_bits < 1 || sketch_bits > 28) {
+                    throw runtime_error("Invalid number of sketch bits.");
+                }
+                options.vocabulary_sketch_bits = sketch_bits;
+            } else if (!strcmp(argv[i], "--dedup")) {
+                options.deduplicate_samples = true;
+            } else if (!strcmp(argv[i], "--write-cache") && i + 1 < argc) {
+                options.sample_cache_path = argv[++i];
+            } else if (!strcmp(argv[i], "--from-cache") && i + 1 < argc) {
+                from_cache = argv[++i];
+            } else if (!strcmp(argv[i], "--out-of-core")) {
+                options.out_of_core = true;
+            } else if (!strcmp(argv[i], "--learning-rate") && i + 1 < argc) {
+                options.learning_rate = atof(argv[++i]);
+                if (options.learning_rate <= 0) {
+                    throw runtime_error("Invalid learning rate.");
+                }
+                options.warm_start_learning_rate = options.learning_rate;
+            } else if (!strcmp(argv[i], "--init-model") && i + 1 < argc) {
+                init_model = argv[++i];
+            } else if (!strcmp(argv[i], "--prior-reg") && i + 1 < argc) {
+                options.prior_regularization = atof(argv[++i]);
+                if (options.prior_regularization < 0) {
+                    throw runtime_error("Invalid prior regularization.");
+                }
+            } else if (argv[i][0] == '-') {
+                cerr << "Unknown option: " << argv[i] << '\n';
+                return 1;
+            } else {
+                files.push_back(argv[i]);
+            }
+        }
+        if (!from_cache.empty() ? files.size() != 1 :
+            !init_model.empty() ? files.size() != 2 :
+            files.size() != 2 && files.size() != 3) {
+            print_usage(argv[0]);
             return 1;
         }
 
-        libsentences::sbd_model model = libsentences::sbd_model::train_model(
-                    argv[1], argc == 4 ? argv[3] : "");
-        model.save(argv[2]);
+        libsentences::sbd_train_stats stats;
+        libsentences::sbd_model model;
+        if (!from_cache.empty()) {
+            model = libsentences::sbd_model::train_model_from_cache(
+                    from_cache, options, &stats);
+            model.save(files[0]);
+        } else if (!init_model.empty()) {
+            // Word classes come from the initial model.
+            model = libsentences::sbd_model::train_model(
+                    files[0], libsentences::sbd_model::load(init_model),
+                    options, &stats);
+            model.save(files[1]);
+        } else {
+            model = libsentences::sbd_model::train_model(
+                    files[0], files.size() == 3 ? files[2] : "", options,
+                    &stats);
+            model.save(files[1]);
+        }
+
+        cerr << "Tokens: " << stats.n_tokens << '\n';
+        cerr << "Samples: " << stats.n_samples << " (" << stats.n_unique_samples
+             << " unique)\n";
+        cerr << "Epochs: " << stats.n_epochs << '/' << options.n_epochs
+             << '\n';
+        cerr << "Training time: " << stats.train_seconds << " s\n";
+        if (stats.validation_f1 >= 0) {
+            cerr << "Validation F1: " << stats.validation_f1 * 100 << '\n';
+            cerr << "Time saved by early stopping: " << stats.seconds_saved
+                 << " s\n";
+        }
     } catch (const exception &e) {
         cerr << e.what() << '\n';
     }
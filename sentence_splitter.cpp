@@ -31,49 +31,960 @@ either expressed or implied, of Frane Saric.
 #include <libsentences/text_sentences.h>
 #include <libsentences/quotes_detector.h>
 #include <libsentences/sbd_model.h>
+#include <libsentences/splitter_stats.h>
+#include <libsentences/mapped_file.h>
+#include <libsentences/stream_sentences.h>
+#include <libsentences/bounded_queue.h>
+#include <libsentences/batch_file_reader.h>
+#include <libsentences/json_field.h>
+#include <libsentences/compressed_input.h>
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <deque>
+#include <memory>
+#include <exception>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 
 using namespace std;
 
-static void read_file(const char *path, string &result) {
-    ifstream ifs(path);
-    if (!ifs.good()) {
-        cerr << "Can't open " << path << '\n';
-        exit(1);
+// Writes byte ranges to a file descriptor (stdout by default) without
+// copying them, gathering up to max_batch of them into one writev call. The
+// ranges must stay valid until flush, which has to be called at the end.
+class batch_writer {
+public:
+    explicit batch_writer(int fd_ = 1) : fd(fd_), n(0) {
     }
-    streambuf *buf = ifs.rdbuf();
-    size_t len = buf->pubseekoff(0, ios_base::end);
-    buf->pubseekoff(0, ios_base::beg);
 
-    result.resize(len);
-    buf->sgetn(&result[0], len);
+    void add(const char *p, size_t len);
+    void add_line(const libsentences::utf8_slice &line);
+    void flush();
+private:
+    static const int max_batch = 1024;
+#ifndef _WIN32
+    iovec iov[max_batch];
+#else
+    struct { const char *p; size_t len; } iov[max_batch];
+#endif
+    int fd;
+    int n;
+};
+
+inline void batch_writer::add(const char *p, size_t len) {
+    if (n == max_batch) {
+        flush();
+    }
+#ifndef _WIN32
+    iov[n].iov_base = const_cast<char *>(p);
+    iov[n].iov_len = len;
+#else
+    iov[n].p = p;
+    iov[n].len = len;
+#endif
+    ++n;
 }
 
-int main(int argc, char **argv) {
-    if (argc != 3) {
-        cerr << "Usage: " << argv[0] << " model input.txt\n";
-        return 1;
+inline void batch_writer::add_line(const libsentences::utf8_slice &line) {
+    add(line.ptr(), line.size());
+    add("\n", 1);
+}
+
+void batch_writer::flush() {
+#ifndef _WIN32
+    iovec *first = iov, *last = iov + n;
+    while (first != last) {
+        ssize_t written = writev(fd, first, last - first);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error(string("Write failed: ") + strerror(errno));
+        }
+        // Skip what was written, the last vector may be written partially.
+        while (first != last && size_t(written) >= first->iov_len) {
+            written -= first->iov_len;
+            ++first;
+        }
+        if (first != last) {
+            first->iov_base = static_cast<char *>(first->iov_base) + written;
+            first->iov_len -= written;
+        }
     }
-    // --quotes_spec=»«:200,«»:20,():20,"":20,'':20
+#else
+    for (int i = 0; i < n; ++i) {
+        const char *p = iov[i].p, *e = p + iov[i].len;
+        while (p != e) {
+            int written = write(fd, p, e - p);
+            if (written <= 0) {
+                throw runtime_error("Write failed.");
+            }
+            p += written;
+        }
+    }
+#endif
+    n = 0;
+}
+
+enum class output_format {
+    text,
+    // Little-endian uint64 start and length of each sentence.
+    offsets_bin,
+    // {"path": ..., "boundaries": [[start, length], ...]} per document.
+    jsonl
+};
+
+static void append_json_string(const string &s, string *out) {
+    *out += '"';
+    for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            *out += '\\';
+            *out += c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            *out += buf;
+        } else {
+            *out += c;
+        }
+    }
+    *out += '"';
+}
+
+// Writes the sentences of documents in one of the output formats. The text
+// format writes the sentences straight from the slices, the others only
+// write their byte offsets in the document.
+class sentence_writer {
+public:
+    explicit sentence_writer(output_format format_, int fd = 1) :
+        format(format_), out(fd), first_in_document(true) {
+    }
+
+    void begin_document(const string &path);
+    void add(const libsentences::utf8_slice &sentence, uint64_t offset);
+    void end_document();
+    // The slices passed to add must stay valid until this is called.
+    void flush();
+private:
+    void append_uint64_le(uint64_t x);
+
+    static const size_t max_buffer = 1 << 20;
 
-    string contents;
-    read_file(argv[2], contents);
+    output_format format;
+    batch_writer out;
+    string buffer;
+    bool first_in_document;
+};
 
-    auto model = libsentences::sbd_model::load(argv[1]);
+void sentence_writer::begin_document(const string &path) {
+    first_in_document = true;
+    if (format == output_format::jsonl) {
+        buffer += "{\"path\": ";
+        append_json_string(path, &buffer);
+        buffer += ", \"boundaries\": [";
+    }
+}
+
+inline void sentence_writer::append_uint64_le(uint64_t x) {
+    for (int i = 0; i < 8; ++i) {
+        buffer += char(x >> (8 * i));
+    }
+}
+
+inline void sentence_writer::add(const libsentences::utf8_slice &sentence,
+                                 uint64_t offset) {
+    switch (format) {
+    case output_format::text:
+        out.add_line(sentence);
+        return;
+    case output_format::offsets_bin:
+        append_uint64_le(offset);
+        append_uint64_le(sentence.size());
+        break;
+    case output_format::jsonl:
+        buffer += first_in_document ? "[" : ", [";
+        buffer += to_string(offset);
+        buffer += ", ";
+        buffer += to_string(sentence.size());
+        buffer += ']';
+        break;
+    }
+    first_in_document = false;
+    if (buffer.size() >= max_buffer) {
+        flush();
+    }
+}
+
+void sentence_writer::end_document() {
+    if (format == output_format::jsonl) {
+        buffer += "]}\n";
+    }
+}
+
+void sentence_writer::flush() {
+    if (!buffer.empty()) {
+        out.add(buffer.data(), buffer.size());
+    }
+    out.flush();
+    buffer.clear();
+}
+
+static void print_stats(const libsentences::splitter_stats &stats) {
+    if (!libsentences::splitter_stats::enabled()) {
+        cerr << "Stats are disabled, rebuild with -DLIBSENTENCES_STATS=ON\n";
+        return;
+    }
+    cerr << "Tokens: " << stats.tokens << '\n'
+         << "Bytes: " << stats.bytes << '\n'
+         << "Sentences: " << stats.sentences << '\n'
+         << "EOS candidate checks: " << stats.eos_candidate_checks << '\n'
+         << "Model evaluations: " << stats.model_evaluations << '\n'
+         << "Vocabulary hits: " << stats.vocabulary_hits << '\n'
+         << "Vocabulary misses: " << stats.vocabulary_misses << '\n'
+         << "Quote activations: " << stats.quote_activations << '\n'
+         << "Quote rewinds: " << stats.quote_rewinds << '\n'
+         << "EOL breaks: " << stats.eol_breaks << '\n';
+    if (libsentences::splitter_stats::timing_enabled()) {
+        uint64_t total = stats.tokenize_ticks + stats.classify_ticks;
+        cerr << "Tokenize ticks: " << stats.tokenize_ticks << '\n'
+             << "Classify ticks: " << stats.classify_ticks << '\n';
+        if (stats.tokens && total) {
+            cerr << "Ticks per token: " << double(total) / stats.tokens
+                 << '\n';
+        }
+    }
+}
+
+// Splits the input (stdin for -) in chunks, so the memory used doesn't grow
+// with the input. Compressed input is decompressed on another thread.
+static int split_stream(const libsentences::sbd_model &model,
+                        const libsentences::quotes_detector &qd,
+                        const string &input_path,
+                        output_format format,
+                        libsentences::splitter_stats *stats) {
+    libsentences::compressed_input input(input_path);
+    libsentences::stream_sentences ss(
+                model,
+                libsentences::sbd_eol_handling::split_on_multiple_eols,
+                &qd,
+                stats);
+    sentence_writer out(format);
+    out.begin_document(input_path);
+    int cnt = 0;
+    auto on_sentence = [&](const libsentences::utf8_slice &sentence) {
+        out.add(sentence, ss.offset(sentence.ptr()));
+        ++cnt;
+    };
+    vector<char> chunk(1 << 20);
+    size_t len;
+    while ((len = input.read(&chunk[0], chunk.size())) > 0) {
+        ss.write(&chunk[0], len, on_sentence);
+        out.flush();
+    }
+    ss.finish(on_sentence);
+    out.end_document();
+    out.flush();
+    return cnt;
+}
+
+// Splits the string field of JSONL records and writes each record with a
+// "sentences" array of [offset, length] pairs appended, in bytes of the
+// escaped field. Records without the field are written unchanged.
+class jsonl_splitter {
+public:
+    jsonl_splitter(const libsentences::sbd_model &model_,
+                   const libsentences::quotes_detector &qd_,
+                   const string &field_,
+                   libsentences::splitter_stats *stats_) :
+        model(model_), qd(qd_), field(field_), stats(stats_), n_appended(0),
+        n_lines(0), n_records(0), n_sentences(0) {
+    }
+
+    // Processes the complete lines in [p, e) and returns the end of the
+    // last one. The lines must stay valid until flush.
+    const char *add_lines(const char *p, const char *e, bool final);
+    void flush();
+
+    uint64_t records() const {
+        return n_records;
+    }
+    uint64_t sentences() const {
+        return n_sentences;
+    }
+private:
+    void add_record(const char *p, const char *e);
+
+    const libsentences::sbd_model &model;
+    const libsentences::quotes_detector &qd;
+    string field;
+    libsentences::splitter_stats *stats;
+    batch_writer out;
+    libsentences::json_unescaped_string text;
+    // What is appended to the records since the last flush. A deque doesn't
+    // move the strings when it grows.
+    deque<string> appended;
+    size_t n_appended;
+    uint64_t n_lines, n_records, n_sentences;
+};
+
+const char *jsonl_splitter::add_lines(const char *p, const char *e,
+                                      bool final) {
+    for (;;) {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', e - p));
+        if (!eol) {
+            if (final && p != e) {
+                ++n_lines;
+                add_record(p, e);
+                p = e;
+            }
+            return p;
+        }
+        ++n_lines;
+        add_record(p, eol + 1);
+        p = eol + 1;
+    }
+}
+
+void jsonl_splitter::add_record(const char *p, const char *e) {
+    const char *content_end = e;
+    while (content_end != p && (content_end[-1] == '\n' ||
+                                content_end[-1] == '\r')) {
+        --content_end;
+    }
+    if (content_end == p) {
+        out.add(p, e - p);
+        return;
+    }
+    try {
+        libsentences::json_object_scanner record(p, content_end, field);
+        if (!record.found()) {
+            out.add(p, e - p);
+            return;
+        }
+        text.assign(record.value_begin(), record.value_end());
+        if (appended.size() == n_appended) {
+            appended.emplace_back();
+        }
+        string &a = appended[n_appended++];
+        a = record.empty() ? "\"sentences\": [" : ", \"sentences\": [";
+        libsentences::text_sentences ts(
+                text.text(),
+                model,
+                libsentences::sbd_eol_handling::split_on_multiple_eols,
+                &qd,
+                stats);
+        const char *base = text.text().data();
+        bool first = true;
+        for (libsentences::text_sentences::iterator i = ts.begin(),
+             e = ts.end(); i != e; ++i) {
+            size_t begin = text.escaped_offset(i->ptr() - base);
+            size_t end = text.escaped_offset(i->ptr() + i->size() - base);
+            a += first ? "[" : ", [";
+            a += to_string(begin);
+            a += ", ";
+            a += to_string(end - begin);
+            a += ']';
+            first = false;
+            ++n_sentences;
+        }
+        a += ']';
+        out.add(p, record.closing_brace() - p);
+        out.add(a.data(), a.size());
+        out.add(record.closing_brace(), e - record.closing_brace());
+        ++n_records;
+    } catch (const runtime_error &err) {
+        throw runtime_error("Line " + to_string(n_lines) + ": " + err.what());
+    }
+}
+
+void jsonl_splitter::flush() {
+    out.flush();
+    n_appended = 0;
+}
+
+// Splits the JSONL file (or stdin for -) in one pass, reading stdin and
+// compressed files in chunks.
+static void split_jsonl(const libsentences::sbd_model &model,
+                        const libsentences::quotes_detector &qd,
+                        const string &input_path, const string &field,
+                        libsentences::splitter_stats *stats) {
+    jsonl_splitter js(model, qd, field, stats);
+    // The input has to outlive the flush after an error.
+    unique_ptr<libsentences::mapped_file> input;
+    vector<char> buffer;
+    try {
+        if (input_path != "-" &&
+            !libsentences::compressed_input::is_compressed(input_path)) {
+            input.reset(new libsentences::mapped_file(input_path));
+            input->advise_sequential();
+            const char *p = input->data(), *e = p + input->size();
+            // Flush now and then, so the appended arrays don't pile up.
+            while (p != e) {
+                const char *chunk_end = p + min<size_t>(1 << 20, e - p);
+                const char *eol = static_cast<const char *>(
+                        memchr(chunk_end, '\n', e - chunk_end));
+                chunk_end = eol ? eol + 1 : e;
+                p = js.add_lines(p, chunk_end, true);
+                js.flush();
+            }
+        } else {
+            libsentences::compressed_input in(input_path);
+            buffer.resize(1 << 20);
+            size_t len = 0;
+            for (;;) {
+                if (len == buffer.size()) {
+                    // A line longer than the buffer.
+                    buffer.resize(2 * buffer.size());
+                }
+                size_t n = in.read(&buffer[len], buffer.size() - len);
+                len += n;
+                const char *p = &buffer[0];
+                const char *rest = js.add_lines(p, p + len, n == 0);
+                js.flush();
+                len -= rest - p;
+                memmove(&buffer[0], rest, len);
+                if (n == 0) {
+                    break;
+                }
+            }
+        }
+    } catch (...) {
+        // Write the records before the invalid one.
+        js.flush();
+        throw;
+    }
+    js.flush();
+    cerr << "Records: " << js.records() << '\n'
+         << "Sentence count: " << js.sentences() << '\n';
+}
+
+// A file passed from the reader through a worker to the writer.
+struct file_job {
+    size_t index;
+    string path;
+    // The file is either mapped or read into text.
+    unique_ptr<libsentences::mapped_file> input;
+    string text;
+    // Set instead if the file couldn't be read.
+    string error;
+    vector<libsentences::utf8_slice> sentences;
+    libsentences::splitter_stats stats;
+
+    libsentences::utf8_slice contents() const;
+};
+
+libsentences::utf8_slice file_job::contents() const {
+    if (input) {
+        return libsentences::utf8_slice(input->data(),
+                                        int64_t(input->size()));
+    }
+    return text;
+}
+
+// Null jobs mark the end of the input.
+typedef libsentences::bounded_queue<unique_ptr<file_job>> job_queue;
+
+struct splitter_options {
+    int n_threads;
+    // When not empty, each file's sentences are written to a file with the
+    // same name in this directory instead of to stdout in input order.
+    string output_dir;
+    // Read the files with batch_file_reader instead of mapping them, which
+    // is faster for many small files.
+    bool bulk;
+    // The input is JSONL and jsonl_field of each record is split.
+    bool jsonl;
+    string jsonl_field;
+    output_format format;
+    bool show_stats;
+};
+
+// Waits while max_in_flight files are read but not written yet, so the
+// writer waiting for a slow file can't make the others pile up.
+// Returns false if the writer failed instead.
+static bool wait_for_writer(size_t i, size_t max_in_flight,
+                            const atomic<size_t> &n_written,
+                            const atomic<bool> &cancelled) {
+    while (i - n_written.load(memory_order_acquire) >= max_in_flight) {
+        if (cancelled.load()) {
+            return false;
+        }
+        this_thread::sleep_for(chrono::microseconds(100));
+    }
+    return !cancelled.load();
+}
+
+// Thrown by the bulk reader's callback to stop reading.
+struct reading_cancelled {
+};
+
+// Reads the compressed file into job->text.
+static void decompress_file(file_job *job) {
+    job->text.clear();
+    try {
+        libsentences::compressed_input(job->path).read_all(&job->text);
+    } catch (const exception &e) {
+        job->text.clear();
+        job->error = e.what();
+    }
+}
+
+// Replaces the compressed contents in job->text with the decompressed text.
+static void decompress_text(file_job *job) {
+    string compressed;
+    compressed.swap(job->text);
+    try {
+        libsentences::compressed_input::decompress(
+                compressed.data(), compressed.size(), job->path, &job->text);
+    } catch (const exception &e) {
+        job->text.clear();
+        job->error = e.what();
+    }
+}
+
+// Stops early when cancelled is set. An error of the reader itself is stored
+// in error; either way, the workers get their end markers.
+static void read_files(const vector<string> &paths, bool bulk, int n_workers,
+                       size_t max_in_flight, const atomic<size_t> &n_written,
+                       const atomic<bool> &cancelled, exception_ptr *error,
+                       job_queue *jobs) {
+    try {
+        if (bulk) {
+            libsentences::batch_file_reader reader;
+            reader.read(paths,
+                        [&](libsentences::batch_file_reader::document &doc) {
+                if (!wait_for_writer(doc.index, max_in_flight, n_written,
+                                     cancelled)) {
+                    throw reading_cancelled();
+                }
+                unique_ptr<file_job> job(new file_job);
+                job->index = doc.index;
+                job->path = doc.path;
+                job->text.swap(doc.text);
+                job->error = doc.error;
+                if (job->error.empty() &&
+                    libsentences::compressed_input::is_compressed(
+                        job->text.data(), job->text.size())) {
+                    decompress_text(job.get());
+                }
+                jobs->push(move(job));
+            });
+        }
+        for (size_t i = 0; !bulk && i < paths.size(); ++i) {
+            if (!wait_for_writer(i, max_in_flight, n_written, cancelled)) {
+                break;
+            }
+            unique_ptr<file_job> job(new file_job);
+            job->index = i;
+            job->path = paths[i];
+            try {
+                if (libsentences::compressed_input::is_compressed(paths[i])) {
+                    decompress_file(job.get());
+                } else {
+                    job->input.reset(new libsentences::mapped_file(paths[i]));
+                    job->input->advise_sequential();
+                    job->input->prefetch();
+                }
+            } catch (const exception &e) {
+                job->error = e.what();
+            }
+            jobs->push(move(job));
+        }
+    } catch (const reading_cancelled &) {
+    } catch (...) {
+        *error = current_exception();
+    }
+    for (int i = 0; i < n_workers; ++i) {
+        jobs->push(unique_ptr<file_job>());
+    }
+}
+
+static void split_files(const libsentences::sbd_model &model,
+                        const libsentences::quotes_detector &qd,
+                        bool show_stats, job_queue *jobs, job_queue *done) {
+    for (;;) {
+        unique_ptr<file_job> job;
+        jobs->pop(&job);
+        if (!job) {
+            done->push(move(job));
+            return;
+        }
+        if (job->error.empty()) {
+            libsentences::text_sentences ts(
+                job->contents(),
+                model,
+                libsentences::sbd_eol_handling::split_on_multiple_eols,
+                &qd,
+                show_stats ? &job->stats : 0);
+            job->sentences.assign(ts.begin(), ts.end());
+        }
+        done->push(move(job));
+    }
+}
+
+static string base_name(const string &path) {
+    size_t slash = path.find_last_of('/');
+    return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+static void write_file_job(const file_job &job, output_format format,
+                           const string &output_dir) {
+    int fd = 1;
+    string out_path;
+    if (!output_dir.empty()) {
+        out_path = output_dir + '/' + base_name(job.path);
+        fd = open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+            throw runtime_error("Can't create " + out_path);
+        }
+    }
+    sentence_writer out(format, fd);
+    try {
+        const char *base = job.contents().ptr();
+        out.begin_document(job.path);
+        for (size_t i = 0; i < job.sentences.size(); ++i) {
+            out.add(job.sentences[i], job.sentences[i].ptr() - base);
+        }
+        out.end_document();
+        out.flush();
+    } catch (...) {
+        if (fd != 1) {
+            close(fd);
+        }
+        throw;
+    }
+    if (fd != 1 && close(fd) != 0) {
+        throw runtime_error("Can't write " + out_path);
+    }
+}
+
+// Splits many files with one reader thread, n_threads workers sharing the
+// model and the calling thread writing the results. Returns false if some
+// files couldn't be read.
+static bool split_files_pipelined(const libsentences::sbd_model &model,
+                                  const libsentences::quotes_detector &qd,
+                                  const vector<string> &paths,
+                                  const splitter_options &options) {
+    int n_workers = max(options.n_threads, 1);
+    size_t queue_size = 4 * n_workers;
+    job_queue jobs(queue_size), done(queue_size);
+    atomic<size_t> n_written(0);
+
+    atomic<bool> cancelled(false);
+    exception_ptr read_error, write_error;
+
+    vector<thread> threads;
+    threads.emplace_back(read_files, cref(paths), options.bulk, n_workers,
+                         2 * queue_size + n_workers, cref(n_written),
+                         cref(cancelled), &read_error, &jobs);
+    for (int i = 0; i < n_workers; ++i) {
+        threads.emplace_back(split_files, cref(model), cref(qd),
+                             options.show_stats, &jobs, &done);
+    }
+
+    bool ok = true;
+    uint64_t cnt = 0;
+    libsentences::splitter_stats stats;
+    // Results that came before some earlier file, when writing in order.
+    map<size_t, unique_ptr<file_job>> pending;
+    for (int n_finished = 0; n_finished < n_workers; ) {
+        unique_ptr<file_job> job;
+        done.pop(&job);
+        if (!job) {
+            ++n_finished;
+            continue;
+        }
+        if (write_error) {
+            // Only wait for the workers to finish.
+            continue;
+        }
+        size_t index = job->index;
+        pending[index] = move(job);
+        try {
+            for (;;) {
+                auto it = options.output_dir.empty() ?
+                    pending.find(n_written.load()) : pending.find(index);
+                if (it == pending.end()) {
+                    break;
+                }
+                const file_job &j = *it->second;
+                if (!j.error.empty()) {
+                    cerr << j.error << '\n';
+                    ok = false;
+                } else {
+                    write_file_job(j, options.format, options.output_dir);
+                    cnt += j.sentences.size();
+                    stats += j.stats;
+                }
+                pending.erase(it);
+                n_written.fetch_add(1, memory_order_release);
+                if (!options.output_dir.empty()) {
+                    break;
+                }
+            }
+        } catch (...) {
+            // Stop reading, so that the threads can be joined.
+            write_error = current_exception();
+            cancelled = true;
+            pending.clear();
+        }
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    if (write_error) {
+        rethrow_exception(write_error);
+    }
+    if (read_error) {
+        rethrow_exception(read_error);
+    }
+    cerr << "Files: " << paths.size() << '\n'
+         << "Sentence count: " << cnt << '\n';
+    if (options.show_stats) {
+        print_stats(stats);
+    }
+    return ok;
+}
+
+static bool is_directory(const string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Regular files in dir, sorted by name.
+static void list_directory(const string &dir, vector<string> *paths) {
+    DIR *d = opendir(dir.c_str());
+    if (!d) {
+        throw runtime_error("Can't open directory " + dir);
+    }
+    vector<string> names;
+    while (dirent *entry = readdir(d)) {
+        string path = dir + '/' + entry->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            names.push_back(path);
+        }
+    }
+    closedir(d);
+    sort(names.begin(), names.end());
+    paths->insert(paths->end(), names.begin(), names.end());
+}
+
+// Makes sure that the output directory exists and that no two inputs would
+// be written to the same file in it.
+static void check_output_paths(const string &output_dir,
+                               const vector<string> &paths) {
+    if (!is_directory(output_dir)) {
+        throw runtime_error("Output directory " + output_dir +
+                            " doesn't exist.");
+    }
+    unordered_map<string, size_t> first_input;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        auto inserted = first_input.insert(make_pair(base_name(paths[i]), i));
+        if (!inserted.second) {
+            throw runtime_error(paths[inserted.first->second] + " and " +
+                                paths[i] + " would both be written to " +
+                                output_dir + '/' + base_name(paths[i]) +
+                                ".");
+        }
+    }
+}
+
+// One path per line, "-" reads the list from stdin.
+static void read_file_list(const string &list_path, vector<string> *paths) {
+    ifstream ifs;
+    if (list_path != "-") {
+        ifs.open(list_path);
+        if (!ifs) {
+            throw runtime_error("Can't open " + list_path);
+        }
+    }
+    istream &is = list_path == "-" ? cin : ifs;
+    string line;
+    while (getline(is, line)) {
+        if (!line.empty()) {
+            paths->push_back(line);
+        }
+    }
+}
+
+static void split(const char *model_path, const char *input_path,
+                  const splitter_options &options) {
+    bool show_stats = options.show_stats;
+    // --quotes_spec=»«:200,«»:20,():20,"":20,'':20
+
+    auto model = libsentences::sbd_model::load(model_path);
+    libsentences::splitter_stats stats;
     libsentences::quotes_detector qd;
     //qd.add_specs("»«:200,«»:20,():20,\"\":20,'':20");
     int cnt = 0;
-    libsentences::text_sentences ts(
-                contents,
-                model, 
+    if (string(input_path) == "-" ||
+        libsentences::compressed_input::is_compressed(input_path)) {
+        cnt = split_stream(model, qd, input_path, options.format,
+                           show_stats ? &stats : 0);
+    } else {
+        libsentences::mapped_file input(input_path);
+        input.advise_sequential();
+
+        libsentences::text_sentences ts(
+                libsentences::utf8_slice(input.data(), int64_t(input.size())),
+                model,
                 libsentences::sbd_eol_handling::split_on_multiple_eols,
-                &qd);
-    for (libsentences::text_sentences::iterator i = ts.begin(),
-         e = ts.end(); i != e; ++i) {
-        cout << *i << '\n';
-        ++cnt;
+                &qd,
+                show_stats ? &stats : 0);
+        sentence_writer out(options.format);
+        out.begin_document(input_path);
+        for (libsentences::text_sentences::iterator i = ts.begin(),
+             e = ts.end(); i != e; ++i) {
+            out.add(*i, i->ptr() - input.data());
+            ++cnt;
+        }
+        out.end_document();
+        out.flush();
     }
     cerr << "Sentence count: " << cnt << '\n';
+    if (show_stats) {
+        print_stats(stats);
+    }
+}
+
+static void usage(const char *prog) {
+    cerr << "Usage: " << prog << " [options] model input...\n"
+         << "Inputs are files, directories (their files, sorted by name) or\n"
+         << "- for stdin. Several inputs are split in parallel. gzip and\n"
+         << "zstd compressed inputs are decompressed.\n"
+         << "  --stats            print splitter counters\n"
+         << "  --threads N        splitting threads (default: all cores)\n"
+         << "  --files-from LIST  also split the files listed in LIST\n"
+         << "  --output-dir DIR   write each file's sentences to DIR\n"
+         << "  --bulk             read many small files in batches\n"
+         << "  --format F         text (default), offsets-bin (uint64\n"
+         << "                     start and length pairs) or jsonl\n"
+         << "  --jsonl            the input is JSONL; add a \"sentences\"\n"
+         << "                     array of the --field (default text)\n"
+         << "                     string's sentences to each record\n";
+}
+
+int main(int argc, char **argv) {
+    splitter_options options;
+    options.n_threads = max<int>(thread::hardware_concurrency(), 1);
+    options.bulk = false;
+    options.jsonl = false;
+    options.jsonl_field = "text";
+    options.format = output_format::text;
+    options.show_stats = false;
+    vector<string> file_lists;
+    bool force_pipeline = false;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] == '-'; ++i) {
+        string arg = argv[i];
+        if (arg == "--stats") {
+            options.show_stats = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.n_threads = atoi(argv[++i]);
+            force_pipeline = true;
+        } else if (arg == "--files-from" && i + 1 < argc) {
+            file_lists.push_back(argv[++i]);
+            force_pipeline = true;
+        } else if (arg == "--output-dir" && i + 1 < argc) {
+            options.output_dir = argv[++i];
+            force_pipeline = true;
+        } else if (arg == "--format" && i + 1 < argc) {
+            string format = argv[++i];
+            if (format == "text") {
+                options.format = output_format::text;
+            } else if (format == "offsets-bin") {
+                options.format = output_format::offsets_bin;
+            } else if (format == "jsonl") {
+                options.format = output_format::jsonl;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--jsonl") {
+            options.jsonl = true;
+        } else if (arg == "--field" && i + 1 < argc) {
+            options.jsonl_field = argv[++i];
+        } else if (arg == "--bulk") {
+            options.bulk = true;
+            force_pipeline = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - i < 1 || (argc - i < 2 && file_lists.empty())) {
+        usage(argv[0]);
+        return 1;
+    }
+    try {
+        const char *model_path = argv[i++];
+        if (options.jsonl) {
+            if (force_pipeline || argc - i != 1) {
+                throw runtime_error("--jsonl takes a single input.");
+            }
+            auto model = libsentences::sbd_model::load(model_path);
+            libsentences::quotes_detector qd;
+            libsentences::splitter_stats stats;
+            split_jsonl(model, qd, argv[i], options.jsonl_field,
+                        options.show_stats ? &stats : 0);
+            if (options.show_stats) {
+                print_stats(stats);
+            }
+            return 0;
+        }
+        if (!force_pipeline && argc - i == 1 &&
+            (string(argv[i]) == "-" || !is_directory(argv[i]))) {
+            split(model_path, argv[i], options);
+            return 0;
+        }
+        vector<string> paths;
+        for (; i < argc; ++i) {
+            if (string(argv[i]) == "-") {
+                throw runtime_error("- can't be combined with other inputs.");
+            }
+            if (is_directory(argv[i])) {
+                list_directory(argv[i], &paths);
+            } else {
+                paths.push_back(argv[i]);
+            }
+        }
+        for (size_t j = 0; j < file_lists.size(); ++j) {
+            read_file_list(file_lists[j], &paths);
+        }
+        if (options.format == output_format::offsets_bin &&
+            options.output_dir.empty() && paths.size() > 1) {
+            throw runtime_error("offsets-bin output of several files "
+                                "needs --output-dir.");
+        }
+        if (!options.output_dir.empty()) {
+            check_output_paths(options.output_dir, paths);
+        }
+        auto model = libsentences::sbd_model::load(model_path);
+        libsentences::quotes_detector qd;
+        if (!split_files_pipelined(model, qd, paths, options)) {
+            return 1;
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << '\n';
+        return 1;
+    }
 }
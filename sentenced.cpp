@@ -0,0 +1,280 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+// Daemon keeping sentence splitting models loaded and splitting documents
+// sent over a Unix domain socket (see libsentences/sentenced_client.h for
+// the protocol).
+
+#include <libsentences/text_sentences.h>
+#include <libsentences/sbd_model.h>
+#include <libsentences/quotes_detector.h>
+#include <libsentences/blocking_queue.h>
+#include <libsentences/sentenced_client.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace libsentences;
+using namespace libsentences::sentenced_protocol;
+
+// A document waiting for a worker. The connection thread that read it waits
+// for the reply.
+struct split_job {
+    const sbd_model *model;
+    string text;
+    promise<string> reply;
+};
+
+// Workers sleep while there is nothing to split.
+typedef blocking_queue<unique_ptr<split_job>> split_job_queue;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) {
+    stop_requested = 1;
+}
+
+static string error_reply(status s, const string &message) {
+    string reply;
+    put_uint32(s, &reply);
+    put_uint64(message.size(), &reply);
+    reply += message;
+    return reply;
+}
+
+static void split_documents(const quotes_detector &qd,
+                            split_job_queue *jobs) {
+    for (;;) {
+        unique_ptr<split_job> job;
+        jobs->pop(&job);
+        try {
+            text_sentences ts(job->text, *job->model,
+                              sbd_eol_handling::split_on_multiple_eols, &qd);
+            string spans;
+            uint64_t n = 0;
+            for (text_sentences::iterator i = ts.begin(), e = ts.end();
+                 i != e; ++i) {
+                put_uint64(i->ptr() - job->text.data(), &spans);
+                put_uint64(i->size(), &spans);
+                ++n;
+            }
+            string reply;
+            reply.reserve(12 + spans.size());
+            put_uint32(ok, &reply);
+            put_uint64(n, &reply);
+            reply += spans;
+            job->reply.set_value(move(reply));
+        } catch (const exception &e) {
+            job->reply.set_value(error_reply(internal_error, e.what()));
+        }
+    }
+}
+
+static void serve_connection(int fd, const vector<sbd_model> &models,
+                             uint64_t max_document_size,
+                             split_job_queue *jobs,
+                             atomic<int> *n_connections) {
+    try {
+        char header[request_header_size];
+        while (read_exactly(fd, header, sizeof(header))) {
+            uint32_t model_index = get_uint32(header);
+            uint64_t len = get_uint64(header + 4);
+            // The rest of the request can't be skipped safely, so errors
+            // end the connection.
+            if (model_index >= models.size()) {
+                string reply = error_reply(bad_model, "No model " +
+                                           to_string(model_index) + ".");
+                write_exactly(fd, reply.data(), reply.size());
+                break;
+            }
+            if (len > max_document_size) {
+                string reply = error_reply(document_too_large,
+                    "Documents are limited to " +
+                    to_string(max_document_size) + " bytes.");
+                write_exactly(fd, reply.data(), reply.size());
+                break;
+            }
+            unique_ptr<split_job> job(new split_job);
+            job->model = &models[model_index];
+            job->text.resize(len);
+            if (len && !read_exactly(fd, &job->text[0], len)) {
+                break;
+            }
+            future<string> reply = job->reply.get_future();
+            jobs->push(move(job));
+            string r = reply.get();
+            write_exactly(fd, r.data(), r.size());
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << '\n';
+    }
+    close(fd);
+    --*n_connections;
+}
+
+static int listen_on(const string &path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw runtime_error("Socket path too long: " + path);
+    }
+    strcpy(addr.sun_path, path.c_str());
+    sockaddr *a = reinterpret_cast<sockaddr *>(&addr);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        throw runtime_error(string("Can't create socket: ") +
+                            strerror(errno));
+    }
+    // Replace a socket left behind by a daemon that died, but not one
+    // that is still answering.
+    if (connect(fd, a, sizeof(addr)) == 0) {
+        close(fd);
+        throw runtime_error("sentenced is already running on " + path);
+    }
+    close(fd);
+    unlink(path.c_str());
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || bind(fd, a, sizeof(addr)) || listen(fd, SOMAXCONN)) {
+        int error = errno;
+        if (fd != -1) {
+            close(fd);
+        }
+        throw runtime_error("Can't listen on " + path + ": " +
+                            strerror(error));
+    }
+    return fd;
+}
+
+static void print_usage(const char *program) {
+    cerr << "Usage: " << program << " [options] socket model...\n"
+         << "Requests name models by their position, starting with 0.\n"
+         << "  --threads N        splitting threads (default: all cores)\n"
+         << "  --max-document MB  largest accepted document (default 64)\n"
+         << "  --max-connections N  connections served at once; more wait\n"
+         << "                     to be accepted (default 256)\n";
+}
+
+int main(int argc, char **argv) {
+    int n_threads = max<int>(thread::hardware_concurrency(), 1);
+    uint64_t max_document_size = 64 << 20;
+    int max_connections = 256;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] == '-'; ++i) {
+        string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            n_threads = max(atoi(argv[++i]), 1);
+        } else if (arg == "--max-document" && i + 1 < argc) {
+            max_document_size = uint64_t(atof(argv[++i]) * (1 << 20));
+        } else if (arg == "--max-connections" && i + 1 < argc) {
+            max_connections = max(atoi(argv[++i]), 1);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - i < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    string socket_path = argv[i++];
+    try {
+        vector<sbd_model> models;
+        for (; i < argc; ++i) {
+            models.push_back(sbd_model::load(argv[i]));
+        }
+        quotes_detector qd;
+
+        int listen_fd = listen_on(socket_path);
+        signal(SIGINT, request_stop);
+        signal(SIGTERM, request_stop);
+        signal(SIGPIPE, SIG_IGN);
+
+        split_job_queue jobs(4 * n_threads);
+        vector<thread> workers;
+        for (int t = 0; t < n_threads; ++t) {
+            workers.emplace_back(split_documents, cref(qd), &jobs);
+        }
+        cerr << "Listening on " << socket_path << " with " << models.size()
+             << " models and " << n_threads << " threads\n";
+
+        atomic<int> n_connections(0);
+        while (!stop_requested) {
+            if (n_connections >= max_connections) {
+                // Further clients wait in the listen backlog.
+                this_thread::sleep_for(chrono::milliseconds(10));
+                continue;
+            }
+            pollfd p = {listen_fd, POLLIN, 0};
+            if (poll(&p, 1, 200) <= 0) {
+                continue;
+            }
+            int fd = accept(listen_fd, 0, 0);
+            if (fd == -1) {
+                continue;
+            }
+            // Connection threads mostly wait for their client; the
+            // splitting itself is limited to the workers.
+            ++n_connections;
+            thread(serve_connection, fd, cref(models), max_document_size,
+                   &jobs, &n_connections).detach();
+        }
+
+        close(listen_fd);
+        unlink(socket_path.c_str());
+        cerr << "Stopped\n";
+        // Exit without destroying the models, which connection threads
+        // may still be using. Open connections are dropped.
+        _exit(0);
+    } catch (const exception &e) {
+        cerr << e.what() << '\n';
+        return 1;
+    }
+}
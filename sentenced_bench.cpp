@@ -0,0 +1,190 @@
+/*
+The code is licensed under the 2-clause, simplified BSD license.
+Copyright 2011 by Frane Saric (frane.saric@gmail.com) . All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY FRANE SARIC ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL FRANE SARIC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of Frane Saric.
+*/
+
+// Load generator for sentenced: several connections send documents as fast
+// as the daemon answers them, and the latency of every request is recorded.
+
+#include <libsentences/sentenced_client.h>
+#include <libsentences/mapped_file.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+
+using namespace std;
+using namespace libsentences;
+
+struct bench_options {
+    int n_connections;
+    int n_requests;
+    size_t document_size;
+    unsigned model_index;
+};
+
+// Cuts text into documents of about document_size bytes, at newlines where
+// possible.
+static vector<utf8_slice> make_documents(const char *p, size_t len,
+                                         size_t document_size) {
+    vector<utf8_slice> docs;
+    const char *e = p + len;
+    while (p != e) {
+        const char *end = p + min<size_t>(document_size, e - p);
+        while (end != e && end[-1] != '\n' &&
+               static_cast<size_t>(end - p) < 2 * document_size) {
+            ++end;
+        }
+        docs.emplace_back(p, end);
+        p = end;
+    }
+    return docs;
+}
+
+static double percentile(const vector<double> &sorted, double q) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t i = min<size_t>(q * sorted.size(), sorted.size() - 1);
+    return sorted[i];
+}
+
+static void print_usage(const char *program) {
+    cerr << "Usage: " << program << " [options] socket corpus.txt\n"
+         << "  --connections N  concurrent connections (default 4)\n"
+         << "  --requests N     requests per connection (default 1000)\n"
+         << "  --doc-size B     document size in bytes (default 2048)\n"
+         << "  --model I        model index (default 0)\n";
+}
+
+int main(int argc, char **argv) {
+    bench_options options;
+    options.n_connections = 4;
+    options.n_requests = 1000;
+    options.document_size = 2048;
+    options.model_index = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] == '-'; ++i) {
+        string arg = argv[i];
+        if (i + 1 == argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (arg == "--connections") {
+            options.n_connections = max(atoi(argv[++i]), 1);
+        } else if (arg == "--requests") {
+            options.n_requests = max(atoi(argv[++i]), 1);
+        } else if (arg == "--doc-size") {
+            options.document_size = max(atoi(argv[++i]), 1);
+        } else if (arg == "--model") {
+            options.model_index = atoi(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - i != 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    string socket_path = argv[i];
+    try {
+        mapped_file corpus(argv[i + 1]);
+        vector<utf8_slice> docs = make_documents(
+                corpus.data(), corpus.size(), options.document_size);
+        if (docs.empty()) {
+            throw runtime_error("The corpus is empty.");
+        }
+
+        vector<vector<double>> latencies(options.n_connections);
+        vector<uint64_t> bytes(options.n_connections), sentences(
+                options.n_connections);
+        vector<string> errors(options.n_connections);
+        vector<thread> threads;
+        auto start = chrono::steady_clock::now();
+        for (int c = 0; c < options.n_connections; ++c) {
+            threads.emplace_back([&, c]() {
+                try {
+                    sentenced_client client(socket_path);
+                    for (int r = 0; r < options.n_requests; ++r) {
+                        const utf8_slice &doc =
+                            docs[(size_t(c) * options.n_requests + r) %
+                                 docs.size()];
+                        auto t0 = chrono::steady_clock::now();
+                        sentences[c] += client.split(
+                                doc, options.model_index).size();
+                        auto t1 = chrono::steady_clock::now();
+                        latencies[c].push_back(
+                            chrono::duration<double, micro>(t1 - t0).count());
+                        bytes[c] += doc.size();
+                    }
+                } catch (const exception &e) {
+                    errors[c] = e.what();
+                }
+            });
+        }
+        for (size_t t = 0; t < threads.size(); ++t) {
+            threads[t].join();
+        }
+        double seconds = chrono::duration<double>(
+                chrono::steady_clock::now() - start).count();
+        for (size_t c = 0; c < errors.size(); ++c) {
+            if (!errors[c].empty()) {
+                throw runtime_error(errors[c]);
+            }
+        }
+
+        vector<double> all;
+        uint64_t total_bytes = 0, total_sentences = 0;
+        for (int c = 0; c < options.n_connections; ++c) {
+            all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+            total_bytes += bytes[c];
+            total_sentences += sentences[c];
+        }
+        sort(all.begin(), all.end());
+        cout << fixed << setprecision(1)
+             << "Requests: " << all.size() << " over "
+             << options.n_connections << " connections\n"
+             << "Sentences: " << total_sentences << '\n'
+             << "Latency (us): p50 " << percentile(all, 0.5)
+             << ", p90 " << percentile(all, 0.9)
+             << ", p99 " << percentile(all, 0.99)
+             << ", max " << all.back() << '\n'
+             << "Throughput: " << all.size() / seconds << " requests/s, "
+             << total_bytes / seconds / (1 << 20) << " MB/s\n";
+    } catch (const exception &e) {
+        cerr << e.what() << '\n';
+        return 1;
+    }
+}